@@ -0,0 +1,386 @@
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <logs.h>
+#include <array.h>
+#include <interner.h>
+
+#include <ast/tree.h>
+#include <ast/flat.h>
+#include <ast/binary.h>
+#include <ast/keyword.h>
+
+static_assert(sizeof(ast_binary_header) == 24, "Binary header must be 24 bytes");
+
+static const size_t POOL_ALIGN = sizeof(double);
+
+static int binary_error(const char *msg);
+
+static inline size_t align_pool(size_t size)
+{
+        return (size + POOL_ALIGN - 1) & ~(POOL_ALIGN - 1);
+}
+
+/*
+ * String table under construction: names in the order
+ * of appearance and an open addressing index of them.
+ */
+struct name_slot {
+        const char *name = nullptr;
+        uint32_t   index = 0;
+};
+
+struct name_table {
+        name_slot *slots = nullptr;
+        size_t capacity  = 0;
+
+        array names = {};
+};
+
+static int expand_name_table(name_table *const table)
+{
+        assert(table);
+
+        size_t capacity = table->capacity ? table->capacity * 2 : 64;
+        name_slot *slots = (name_slot *)calloc(capacity, sizeof(name_slot));
+        if (!slots)
+                return 1;
+
+        for (size_t i = 0; i < table->capacity; i++) {
+                name_slot *old = &table->slots[i];
+                if (!old->name)
+                        continue;
+
+                size_t j = ((uintptr_t)old->name >> 3) * 0x9E3779B97F4A7C15ull;
+                for (j &= capacity - 1; slots[j].name; j = (j + 1) & (capacity - 1))
+                        ;
+
+                slots[j] = *old;
+        }
+
+        free(table->slots);
+        table->slots    = slots;
+        table->capacity = capacity;
+
+        return 0;
+}
+
+static int add_name(name_table *const table, const char *name, uint32_t *index)
+{
+        assert(table);
+        assert(name);
+        assert(index);
+
+        /* Keep load factor below 1/2 */
+        if (table->names.size * 2 >= table->capacity && expand_name_table(table))
+                return 1;
+
+        size_t mask = table->capacity - 1;
+        size_t i = ((uintptr_t)name >> 3) * 0x9E3779B97F4A7C15ull;
+        for (i &= mask; table->slots[i].name; i = (i + 1) & mask) {
+                if (table->slots[i].name == name) {
+                        *index = table->slots[i].index;
+                        return 0;
+                }
+        }
+
+        *index = (uint32_t)table->names.size;
+        if (!array_push(&table->names, &name, sizeof(const char *)))
+                return 1;
+
+        table->slots[i].name  = name;
+        table->slots[i].index = *index;
+
+        return 0;
+}
+
+static void free_name_table(name_table *const table)
+{
+        assert(table);
+
+        free(table->slots);
+        free_array(&table->names, sizeof(const char *));
+}
+
+static bool valid_keyword(uint32_t keyword)
+{
+#define AST(name, id, str) case AST_##name: return true;
+
+        switch (keyword) {
+#include "../AST"
+        default:
+                return false;
+        }
+
+#undef AST
+}
+
+int save_binary_tree(FILE *file, ast_node *const root)
+{
+        assert(file);
+        assert(root);
+
+        flat_tree flat = {};
+        int error = flatten_tree(&flat, root);
+        if (!error)
+                error = save_flat_binary(file, &flat);
+
+        free_flat_tree(&flat);
+        return error;
+}
+
+int save_flat_binary(FILE *file, const flat_tree *const flat)
+{
+        assert(file);
+        assert(flat);
+        assert(flat->nodes.size);
+
+        size_t n_nodes = flat->nodes.size;
+        if (n_nodes > UINT32_MAX || flat->constants.size > UINT32_MAX)
+                return binary_error("Tree is too big");
+
+        flat_node *nodes = (flat_node *)calloc(n_nodes, sizeof(flat_node));
+        if (!nodes)
+                return binary_error("Can't allocate nodes");
+
+        memcpy(nodes, flat->nodes.data, n_nodes * sizeof(flat_node));
+
+        /* Names are interned, equal names are deduplicated by address */
+        name_table names = {};
+
+        int error = 0;
+        size_t strings_size = 0;
+        for (size_t i = 0; i < n_nodes; i++) {
+                if (nodes[i].type != AST_NODE_IDENT)
+                        continue;
+
+                const char *ident = flat_ident(flat, &nodes[i]);
+
+                size_t n_names = names.names.size;
+                if (add_name(&names, ident, &nodes[i].data)) {
+                        error = binary_error("Can't add a name");
+                        goto cleanup;
+                }
+
+                if (names.names.size != n_names)
+                        strings_size += strlen(ident) + 1;
+        }
+
+        {
+                size_t padded = align_pool(strings_size);
+                if (padded > UINT32_MAX) {
+                        error = binary_error("String table is too big");
+                        goto cleanup;
+                }
+
+                ast_binary_header header = {};
+                memcpy(header.magic, AST_BINARY_MAGIC, sizeof(header.magic));
+                header.version      = AST_BINARY_VERSION;
+                header.n_strings    = (uint32_t)names.names.size;
+                header.strings_size = (uint32_t)padded;
+                header.n_constants  = (uint32_t)flat->constants.size;
+                header.n_nodes      = (uint32_t)n_nodes;
+
+                fwrite(&header, sizeof(header), 1, file);
+
+                const char **table = (const char **)names.names.data;
+                for (uint32_t i = 0; i < header.n_strings; i++)
+                        fwrite(table[i], 1, strlen(table[i]) + 1, file);
+
+                static const char zeros[POOL_ALIGN] = {};
+                fwrite(zeros, 1, padded - strings_size, file);
+
+                if (header.n_constants)
+                        fwrite(flat->constants.data, sizeof(double), header.n_constants, file);
+
+                fwrite(nodes, sizeof(flat_node), n_nodes, file);
+
+                if (ferror(file))
+                        error = binary_error("Can't write the tree");
+        }
+
+cleanup:
+        free_name_table(&names);
+        free(nodes);
+
+        return error;
+}
+
+bool is_binary_tree(const char *buf, size_t size)
+{
+        assert(buf);
+
+        return size >= sizeof(ast_binary_header) &&
+               !memcmp(buf, AST_BINARY_MAGIC, sizeof(AST_BINARY_MAGIC));
+}
+
+static int check_flat_nodes(const flat_tree *const flat)
+{
+        assert(flat);
+
+        const flat_node *nodes = (const flat_node *)flat->nodes.data;
+        size_t n_nodes = flat->nodes.size;
+
+        for (size_t i = 0; i < n_nodes; i++) {
+                const flat_node *node = &nodes[i];
+
+                /* Children follow their parent, so there are no cycles */
+                if ((node->left  && (node->left  <= i || node->left  >= n_nodes)) ||
+                    (node->right && (node->right <= i || node->right >= n_nodes)))
+                        return binary_error("Invalid child index");
+
+                switch (node->type) {
+                case AST_NODE_KEYWORD:
+                        if (!valid_keyword(node->data))
+                                return binary_error("Invalid keyword");
+                        break;
+                case AST_NODE_NUMBER:
+                        if (node->data >= flat->constants.size)
+                                return binary_error("Invalid constant index");
+                        break;
+                case AST_NODE_IDENT:
+                        if (node->data >= flat->names.size)
+                                return binary_error("Invalid name index");
+                        break;
+                default:
+                        return binary_error("Invalid node type");
+                }
+        }
+
+        return 0;
+}
+
+/*
+ * Checks the header and the sizes of the sections.
+ */
+static int read_header(const char *buf, size_t size, ast_binary_header *header)
+{
+        assert(buf);
+        assert(header);
+
+        if (!is_binary_tree(buf, size))
+                return binary_error("Not a binary tree");
+
+        memcpy(header, buf, sizeof(*header));
+
+        if (header->version != AST_BINARY_VERSION)
+                return binary_error("Unsupported version");
+
+        if (!header->n_nodes)
+                return binary_error("Tree is empty");
+
+        size_t constants_size = (size_t)header->n_constants * sizeof(double);
+        size_t nodes_size     = (size_t)header->n_nodes     * sizeof(flat_node);
+        if (header->strings_size % POOL_ALIGN ||
+            size - sizeof(*header) < header->strings_size + constants_size + nodes_size)
+                return binary_error("Tree is truncated");
+
+        return 0;
+}
+
+static int read_names(const char *buf, const ast_binary_header *header,
+                      interner *const idents, flat_tree *const flat)
+{
+        assert(buf);
+        assert(header);
+        assert(idents);
+        assert(flat);
+
+        const char *str = buf + sizeof(*header);
+        const char *end = str + header->strings_size;
+
+        for (uint32_t i = 0; i < header->n_strings; i++) {
+                const char *nul = (const char *)memchr(str, '\0', (size_t)(end - str));
+                if (!nul)
+                        return binary_error("Invalid string table");
+
+                const char *ident = intern(idents, str, (size_t)(nul - str));
+                if (!ident || !array_push(&flat->names, &ident, sizeof(const char *)))
+                        return binary_error("Can't intern a name");
+
+                str = nul + 1;
+        }
+
+        return 0;
+}
+
+int read_binary_tree(const char *buf, size_t size,
+                     interner *const idents, flat_tree *const flat)
+{
+        assert(buf);
+        assert(idents);
+        assert(flat);
+        assert(!flat->nodes.size);
+
+        ast_binary_header header = {};
+        if (read_header(buf, size, &header) || read_names(buf, &header, idents, flat))
+                return 1;
+
+        const char *constants = buf + sizeof(header) + header.strings_size;
+        const char *nodes     = constants + header.n_constants * sizeof(double);
+
+        if (header.n_constants &&
+            !array_append(&flat->constants, constants, header.n_constants, sizeof(double)))
+                return binary_error("Can't load constants");
+
+        if (!array_append(&flat->nodes, nodes, header.n_nodes, sizeof(flat_node)))
+                return binary_error("Can't load nodes");
+
+        return check_flat_nodes(flat);
+}
+
+int map_binary_tree(char *buf, size_t size,
+                    interner *const idents, flat_tree *const flat)
+{
+        assert(buf);
+        assert(idents);
+        assert(flat);
+        assert(!flat->nodes.size);
+
+        if ((uintptr_t)buf % POOL_ALIGN)
+                return binary_error("Image is misaligned");
+
+        ast_binary_header header = {};
+        if (read_header(buf, size, &header) || read_names(buf, &header, idents, flat))
+                return 1;
+
+        char *constants = buf + sizeof(header) + header.strings_size;
+        char *nodes     = constants + header.n_constants * sizeof(double);
+
+        flat->mapped = true;
+
+        flat->constants.data      = constants;
+        flat->constants.size      = header.n_constants;
+        flat->constants.capacity  = header.n_constants;
+        flat->constants.item_size = sizeof(double);
+
+        flat->nodes.data      = nodes;
+        flat->nodes.size      = header.n_nodes;
+        flat->nodes.capacity  = header.n_nodes;
+        flat->nodes.item_size = sizeof(flat_node);
+
+        return check_flat_nodes(flat);
+}
+
+int load_flat_tree(char *buf, size_t size,
+                   interner *const idents, flat_tree *const flat)
+{
+        assert(buf);
+        assert(idents);
+        assert(flat);
+
+        if (is_binary_tree(buf, size))
+                return map_binary_tree(buf, size, idents, flat);
+
+        return read_flat_tree(&buf, idents, flat);
+}
+
+static int binary_error(const char *msg)
+{
+        assert(msg);
+
+        fprintf(stderr, ascii(red, "Binary tree: %s\n"), msg);
+        return 1;
+}
@@ -167,7 +167,7 @@ void dump_tree(ast_node *root)
         gvprint(HEADER);
 
         /*
-         * Recursively jumps from node to node and prints it.
+         * Jumps from node to node and prints it.
          */
         visit_tree(root, print_node);
 
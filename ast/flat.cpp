@@ -0,0 +1,226 @@
+#include <stdio.h>
+#include <assert.h>
+#include <stdint.h>
+#include <logs.h>
+#include <array.h>
+
+#include <ast/tree.h>
+#include <ast/flat.h>
+#include <ast/walk.h>
+
+static_assert(sizeof(flat_node) == 16, "Flat node must be 16 bytes");
+
+int reserve_flat_node(flat_tree *const flat, uint32_t *index)
+{
+        assert(flat);
+        assert(index);
+        assert(!flat->mapped);
+
+        if (flat->nodes.size >= UINT32_MAX)
+                return 1;
+
+        flat_node newbie = {};
+
+        *index = (uint32_t)flat->nodes.size;
+        if (!array_push(&flat->nodes, &newbie, sizeof(flat_node)))
+                return 1;
+
+        return 0;
+}
+
+int set_flat_node(flat_tree *const flat, uint32_t index, const ast_node *value,
+                  uint32_t left, uint32_t right)
+{
+        assert(flat);
+        assert(value);
+        assert(!flat->mapped);
+        assert(index < flat->nodes.size);
+
+        uint32_t data = 0;
+        switch (value->type) {
+        case AST_NODE_KEYWORD:
+                data = (uint32_t)value->data.keyword;
+                break;
+        case AST_NODE_NUMBER: {
+                double number = value->data.number;
+                data = (uint32_t)flat->constants.size;
+                if (!array_push(&flat->constants, &number, sizeof(double)))
+                        return 1;
+                break;
+        }
+        case AST_NODE_IDENT: {
+                const char *ident = value->data.ident;
+                data = (uint32_t)flat->names.size;
+                if (!array_push(&flat->names, &ident, sizeof(const char *)))
+                        return 1;
+                break;
+        }
+        default:
+                assert(0);
+                return 1;
+        }
+
+        flat_node *node = (flat_node *)flat->nodes.data + index;
+        node->type  = (uint32_t)value->type;
+        node->data  = data;
+        node->left  = left;
+        node->right = right;
+
+        return 0;
+}
+
+/*
+ * Nodes on the walk path with their reserved indices
+ * and the indices of their children appended so far.
+ */
+struct flatten_frame {
+        const ast_node *node = nullptr;
+
+        uint32_t index = 0;
+        uint32_t left  = 0;
+        uint32_t right = 0;
+};
+
+struct flatten_ctx {
+        flat_tree *flat = nullptr;
+        array path      = {};
+};
+
+static int flatten_node(ast_node *node, void *ctx)
+{
+        flatten_ctx *fl = (flatten_ctx *)ctx;
+
+        flatten_frame frame = {};
+        frame.node = node;
+
+        if (reserve_flat_node(fl->flat, &frame.index))
+                return WALK_STOP;
+
+        if (fl->path.size) {
+                flatten_frame *parent = (flatten_frame *)array_top(&fl->path,
+                                                                   sizeof(flatten_frame));
+                if (parent->node->left == node && !parent->left)
+                        parent->left  = frame.index;
+                else
+                        parent->right = frame.index;
+        }
+
+        if (!array_push(&fl->path, &frame, sizeof(flatten_frame)))
+                return WALK_STOP;
+
+        return WALK_NEXT;
+}
+
+static int flatten_done(ast_node *node, void *ctx)
+{
+        flatten_ctx *fl = (flatten_ctx *)ctx;
+
+        flatten_frame *frame = (flatten_frame *)array_top(&fl->path, sizeof(flatten_frame));
+        if (set_flat_node(fl->flat, frame->index, node, frame->left, frame->right))
+                return WALK_STOP;
+
+        array_pop(&fl->path, sizeof(flatten_frame));
+        return WALK_NEXT;
+}
+
+int flatten_tree(flat_tree *const flat, const ast_node *root)
+{
+        assert(flat);
+        assert(root);
+        assert(!flat->nodes.size);
+
+        flatten_ctx ctx = {};
+        ctx.flat = flat;
+
+        ast_visitor flattener = {};
+        flattener.pre  = flatten_node;
+        flattener.post = flatten_done;
+        flattener.ctx  = &ctx;
+
+        /* The walk doesn't change the tree */
+        int error = walk_tree(const_cast<ast_node *>(root), &flattener);
+        free_array(&ctx.path, sizeof(flatten_frame));
+
+        if (error) {
+                fprintf(logs, "Can't flatten the tree\n");
+                return 1;
+        }
+
+        return 0;
+}
+
+void free_flat_tree(flat_tree *const flat)
+{
+        assert(flat);
+
+        if (flat->mapped) {
+                flat->nodes     = {};
+                flat->constants = {};
+                flat->mapped    = false;
+        } else {
+                free_array(&flat->nodes,     sizeof(flat_node));
+                free_array(&flat->constants, sizeof(double));
+        }
+
+        free_array(&flat->names, sizeof(const char *));
+}
+
+struct save_ctx {
+        FILE *file = nullptr;
+        const flat_tree *flat = nullptr;
+};
+
+static int save_open(const flat_node *, void *ctx)
+{
+        fprintf(((save_ctx *)ctx)->file, "(");
+        return WALK_NEXT;
+}
+
+static int save_data(const flat_node *node, void *ctx)
+{
+        FILE *file = ((save_ctx *)ctx)->file;
+        const flat_tree *flat = ((save_ctx *)ctx)->flat;
+
+        switch (node->type) {
+        case AST_NODE_IDENT:
+                fprintf(file, "'%s'", flat_ident(flat, node));
+                break;
+        case AST_NODE_NUMBER:
+                fprintf(file, "%lg", *flat_number(flat, node));
+                break;
+        case AST_NODE_KEYWORD:
+                fprintf(file, "%s", ast_keyword_string(flat_keyword(node)));
+                break;
+        default:
+                assert(0);
+                break;
+        }
+
+        return WALK_NEXT;
+}
+
+static int save_close(const flat_node *, void *ctx)
+{
+        fprintf(((save_ctx *)ctx)->file, ")");
+        return WALK_NEXT;
+}
+
+void save_flat_tree(FILE *file, const flat_tree *const flat,
+                    const flat_node *node)
+{
+        assert(file);
+        assert(flat);
+        assert(node);
+
+        save_ctx ctx = {};
+        ctx.file = file;
+        ctx.flat = flat;
+
+        flat_visitor saver = {};
+        saver.pre  = save_open;
+        saver.in   = save_data;
+        saver.post = save_close;
+        saver.ctx  = &ctx;
+
+        walk_flat_tree(flat, node, &saver);
+}
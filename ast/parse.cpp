@@ -1,85 +1,228 @@
 #include <stdio.h>
 #include <string.h>
+#include <stdint.h>
 #include <iommap.h>
 #include <assert.h>
 #include <stdlib.h>
 #include <ctype.h>
 #include <logs.h>
 #include <array.h>
+#include <interner.h>
 
 #include <ast/tree.h>
+#include <ast/flat.h>
 #include <ast/keyword.h>
 
 static ast_node *syntax_error(char *str);
 static ast_node *core_error();
 
-static ast_node *read_ast_node(char **str, array *const idents);
-
-static ast_node *read_keyword(char *str, size_t length);
-static ast_node *read_data(char **str, array *const idents);
-
-static ast_node *create_ident(const char *str, array *const idents, const size_t len);
-
-static char *find_bracket(char *str);
-static char *rfind(char *str, char ch);
+static int scan_data(char **str, interner *const idents, ast_node *value);
 
 static inline void skip_spaces(char **str);
 static inline void move(char **str);
 static inline char cur(char **str);
 
-ast_node *read_ast_tree(char **str, array *const idents)
+/*
+ * Text tree is read in one forward pass:
+ *
+ *      node := '(' [node] data [node] ')'
+ *      data := number | 'ident' | keyword
+ *
+ * Open nodes wait on an explicit stack. A node is built when
+ * its ')' is read, the children are ready by then.
+ */
+enum read_state {
+        READ_OPEN  = 0,
+        READ_DATA  = 1,
+        READ_CLOSE = 2,
+};
+
+template <typename handle_t>
+struct read_frame {
+        ast_node value = {};
+
+        handle_t self  = {};
+        handle_t left  = {};
+        handle_t right = {};
+
+        /* What the node waits for after its current child */
+        int state = READ_DATA;
+};
+
+struct ast_builder {};
+
+static inline int open_node(ast_builder *, read_frame<ast_node *> *)
 {
-        assert(str);
-        assert(idents);
+        return 0;
+}
 
-        ast_node *tree = read_ast_node(str, idents);
-        if (!tree)
-                return syntax_error(*str);
+static inline int close_node(ast_builder *, read_frame<ast_node *> *frame)
+{
+        ast_node *node = create_ast_node(frame->value.type);
+        if (!node)
+                return 1;
 
-        if (**str != '\0')
-                return syntax_error(*str);
+        node->data  = frame->value.data;
+        node->left  = frame->left;
+        node->right = frame->right;
+        node->hash  = hash_ast_node(node);
 
-        return tree;
+        frame->self = node;
+        return 0;
 }
 
-static ast_node *read_ast_node(char **str, array *const idents)
+/*
+ * The flat node is reserved when it is opened,
+ * so the nodes come in preorder.
+ */
+static inline int open_node(flat_tree *flat, read_frame<uint32_t> *frame)
+{
+        return reserve_flat_node(flat, &frame->self);
+}
+
+static inline int close_node(flat_tree *flat, read_frame<uint32_t> *frame)
+{
+        return set_flat_node(flat, frame->self, &frame->value,
+                             frame->left, frame->right);
+}
+
+/*
+ * Returns 0 on success, 1 on syntax error and -1 if
+ * memory is out. '*str' is left where reading stopped.
+ */
+template <typename builder_t, typename handle_t>
+static int read_tree(char **str, interner *const idents,
+                     builder_t *builder, handle_t *root)
 {
         assert(str);
         assert(idents);
+        assert(builder);
+        assert(root);
 
-        skip_spaces(str);
-        if (cur(str) != '(')
-                return nullptr;
+        typedef read_frame<handle_t> frame;
+
+        array stack = {};
+        frame *top  = nullptr;
+
+        int error = 0;
+        int state = READ_OPEN;
 
-        move(str);
         skip_spaces(str);
+        while (!error) {
+                if (state == READ_OPEN) {
+                        if (cur(str) != '(') {
+                                error = 1;
+                                break;
+                        }
+
+                        move(str);
+                        skip_spaces(str);
+
+                        frame node = {};
+                        if (open_node(builder, &node)) {
+                                error = -1;
+                                break;
+                        }
+
+                        top = (frame *)array_push(&stack, &node, sizeof(frame));
+                        if (!top) {
+                                error = -1;
+                                break;
+                        }
+
+                        /* Left child comes first, if any */
+                        state = cur(str) == '(' ? READ_OPEN : READ_DATA;
+                        continue;
+                }
+
+                if (state == READ_DATA) {
+                        if (scan_data(str, idents, &top->value)) {
+                                error = 1;
+                                break;
+                        }
+
+                        skip_spaces(str);
+
+                        top->state = READ_CLOSE;
+                        state = cur(str) == '(' ? READ_OPEN : READ_CLOSE;
+                        continue;
+                }
 
-        ast_node *left = nullptr;
-        if (cur(str) == '(') {
-                left = read_ast_node(str, idents);
-                if (!left)
-                        return nullptr;
+                if (cur(str) != ')') {
+                        error = 1;
+                        break;
+                }
+
+                move(str);
+                skip_spaces(str);
+
+                if (close_node(builder, top)) {
+                        error = -1;
+                        break;
+                }
+
+                handle_t node = top->self;
+                array_pop(&stack, sizeof(frame));
+
+                if (!stack.size) {
+                        *root = node;
+                        break;
+                }
+
+                top = (frame *)array_top(&stack, sizeof(frame));
+                if (top->state == READ_DATA)
+                        top->left  = node;
+                else
+                        top->right = node;
+
+                state = top->state;
         }
 
-        ast_node *root = read_data(str, idents);
-        if (!root)
-                return nullptr;
+        free_array(&stack, sizeof(frame));
+        return error;
+}
+
+ast_node *read_ast_tree(char **str, interner *const idents)
+{
+        assert(str);
+        assert(idents);
 
-        skip_spaces(str);
-        ast_node *right = nullptr;
-        if (cur(str) == '(') {
-                right = read_ast_node(str, idents);
-                if (!right)
-                        return nullptr;
+        ast_builder builder = {};
+        ast_node *tree = nullptr;
+
+        int error = read_tree(str, idents, &builder, &tree);
+        if (error < 0)
+                return core_error();
+
+        if (error || **str != '\0')
+                return syntax_error(*str);
+
+        return tree;
+}
+
+int read_flat_tree(char **str, interner *const idents, flat_tree *const flat)
+{
+        assert(str);
+        assert(idents);
+        assert(flat);
+        assert(!flat->nodes.size);
+
+        uint32_t root = 0;
+
+        int error = read_tree(str, idents, flat, &root);
+        if (error < 0) {
+                core_error();
+                return 1;
         }
 
-        root->left  = left;
-        root->right = right;
+        if (error || **str != '\0') {
+                syntax_error(*str);
+                return 1;
+        }
 
-        move(str);
-        skip_spaces(str);
-        return root;
+        return 0;
 }
+
 /*
 int main() 
 {
@@ -89,45 +232,17 @@ int main()
                 return 0;
 
         char *r = md.buf;
-        array idents = {0};
+        interner idents = {};
         ast_node *rt = read_ast_tree(&r, &idents);
         if (rt)
                 dump_tree(rt);
 
         mmap_free(&md);
-        char **data = (char **)idents.data;
-        for (size_t i = 0; i < idents.size; i++) {
-                free(data[i]);
-        }
-
-        free_array(&idents, sizeof(char *));
+        free_interner(&idents);
 
         return 0;
 }*/
 
-static ast_node *read_keyword(char *str, size_t length) 
-{
-        assert(str);
-
-#define AST(name, keyword, ident)                                                 \
-                if (sizeof(ident) - 1 == length) {                                \
-                        if (!strncmp(ident, str, length)) {                       \
-                                ast_node *newbie = create_ast_keyword(keyword);   \
-                                if (!newbie)                                      \
-                                        return core_error();                      \
-                                                                                  \
-                                return newbie;                                    \
-                        }                                                         \
-                }
-
-                if (0) {} 
-#include "../AST"
-
-#undef AST 
-
-        return syntax_error(str);
-}
-
 static ast_node *syntax_error(char *str)
 {
         fprintf(stderr, ascii(red, "Syntax error: %s"), str);
@@ -140,103 +255,121 @@ static ast_node *core_error()
         return nullptr;
 }
 
-static ast_node *create_ident(const char *str, array *const idents, const size_t len)
+/*
+ * Numbers are saved with "%lg", which includes "inf" and "nan".
+ * Other data never starts like this, strtod() is not tried on it.
+ */
+static inline bool number_start(char ch)
+{
+        return isdigit((unsigned char)ch) || ch == '-' || ch == '+' || ch == '.' ||
+               ch == 'i' || ch == 'I' || ch == 'n' || ch == 'N';
+}
+
+/*
+ * Most constants are small integers. They are exact in a double,
+ * so they are converted here, everything else goes to strtod().
+ * Returns false if 'str' is not such an integer.
+ */
+static inline bool scan_integer(char *str, char **end, double *number)
 {
         assert(str);
-        assert(idents);
+        assert(end);
+        assert(number);
 
-        char *ident = nullptr;
-        char **keys = (char **)idents->data;
-        for (size_t i = 0; i < idents->size; i++) {
-                if (strlen(keys[i]) == len && !strncmp(keys[i], str, len)) {
-                        ident = keys[i];
-                        break;
-                }
-        }
+        static const int MAX_DIGITS = 15;
 
-        if (!ident) {
-                ident = (char *)calloc(len + 1, sizeof(char));
-                if (!ident)
-                        return core_error();
+        bool negative = *str == '-';
+        if (negative)
+                str++;
 
-                strncpy(ident, str, len);
-                ident[len] = '\0';
+        int64_t value = 0;
+        int n_digits = 0;
+        for (; isdigit((unsigned char)*str); str++, n_digits++) {
+                if (n_digits == MAX_DIGITS)
+                        return false;
 
-                array_push(idents, &ident, sizeof(char *));
+                value = value * 10 + (*str - '0');
         }
 
-        ast_node *root = create_ast_ident(ident);
-        if (!root)
-                return core_error();
+        if (!n_digits || *str == '.' || *str == 'e' || *str == 'E')
+                return false;
 
-        return root;
+        *number = negative ? -(double)value : (double)value;
+        *end    = str;
+        return true;
 }
 
-static ast_node *read_data(char **str, array *const idents)
+/*
+ * Keywords end at a space or a bracket.
+ */
+static inline bool keyword_end(char ch)
+{
+        return ch == '\0' || ch == '(' || ch == ')' || ch == '\'' || isspace((unsigned char)ch);
+}
+
+/*
+ * Reads type and data of the node into 'value'
+ * without allocating it. Returns 0 on success.
+ */
+static int scan_data(char **str, interner *const idents, ast_node *value)
 {
         assert(str);
         assert(idents);
+        assert(value);
 
-        ast_node *root = nullptr;
+        skip_spaces(str);
 
         char *end = *str;
-        double number = strtod(*str, &end);
-        if (end != *str) {
-                root = create_ast_number(number);
-                if (!root)
-                        return core_error();
-
-                *str = end;
-                return root;
+        if (number_start(cur(str))) {
+                double number = 0;
+                if (!scan_integer(*str, &end, &number))
+                        number = strtod(*str, &end);
+
+                if (end != *str) {
+                        value->type = AST_NODE_NUMBER;
+                        set_ast_number(value, number);
+
+                        *str = end;
+                        return 0;
+                }
         }
 
-        skip_spaces(str);
         if (cur(str) == '\'') {
-                end = find_bracket(*str);
-                end = rfind(end, '\'');
-                if (*str == end)
-                        return syntax_error(*str);
-
                 move(str);
-                root = create_ident(*str, idents,(size_t)(end - *str));
-                if (!root)
-                        return core_error();
-
-                *str = end + 1;
-                return root;
-        }
 
-        end = find_bracket(*str);
-        end--;
-        while (isspace(*end))
-                end--;
+                end = *str;
+                while (*end != '\0' && *end != '\'')
+                        end++;
 
-        root = read_keyword(*str, (size_t)(end - *str + 1));
-        if (!root)
-                return syntax_error(*str);
+                if (*end != '\'')
+                        return 1;
 
-        *str = end + 1;
-        return root;
-}
+                const char *ident = intern(idents, *str, (size_t)(end - *str));
+                if (!ident) {
+                        core_error();
+                        return 1;
+                }
 
-static char *find_bracket(char *str)
-{
-        assert(str);
+                value->type = AST_NODE_IDENT;
+                set_ast_ident(value, ident);
 
-        while (*str != '\0' && *str != ')' && *str != '(')
-                str++;
+                *str = end + 1;
+                return 0;
+        }
 
-        return str;
-}
+        end = *str;
+        while (!keyword_end(*end))
+                end++;
 
-static char *rfind(char *str, char ch)
-{
-        assert(str);
+        int keyword = find_ast_keyword(*str, (size_t)(end - *str));
+        if (keyword == -1)
+                return 1;
 
-        while (*str != ch)
-                str--;
+        value->type = AST_NODE_KEYWORD;
+        set_ast_keyword(value, keyword);
 
-        return str;
+        *str = end;
+        return 0;
 }
 
 static inline void skip_spaces(char **str)
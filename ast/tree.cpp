@@ -3,62 +3,78 @@
 #include <stdlib.h>
 #include <logs.h>
 #include <errno.h>
-#include <stack.h>
+#include <arena.h>
+#include <phash.h>
 
 #include <ast/tree.h>
+#include <ast/walk.h>
 #include <ast/keyword.h>
 
 
-static stack ALLOC = {0};
+/* Nodes created without an arena of their own */
+static arena DEFAULT_NODES = {};
+static thread_local arena *NODES = nullptr;
 
-__attribute__((constructor))
-static void init_memstack()
-{ 
-        construct_stack(&ALLOC);
-}
+static thread_local ast_cons *CONS = nullptr;
 
 __attribute__((destructor))
-static void free_memstack()
+static void free_default_nodes()
 {
-        $(dump_stack(&ALLOC);)
-        while (ALLOC.size) {
-                void *item = pop_stack(&ALLOC);
-                free(item);
-        }
-
-        destruct_stack(&ALLOC);
+        free_arena(&DEFAULT_NODES);
 }
 
-
-void save_ast_tree(FILE *file, ast_node *const node)
+arena *use_ast_arena(arena *const nodes)
 {
-        assert(file);
-        assert(node);
+        arena *prev = NODES;
+        NODES = nodes;
 
-        fprintf(file, "(");
+        return prev;
+}
 
-        if (node->left)
-                save_ast_tree(file, node->left);
+static int save_open(ast_node *, void *file)
+{
+        fprintf((FILE *)file, "(");
+        return WALK_NEXT;
+}
 
+static int save_data(ast_node *node, void *file)
+{
         switch (node->type) {
         case AST_NODE_IDENT:
-                fprintf(file, "'%s'", ast_ident(node));
+                fprintf((FILE *)file, "'%s'", ast_ident(node));
                 break;
         case AST_NODE_NUMBER:
-                fprintf(file, "%lg", ast_number(node));
+                fprintf((FILE *)file, "%lg", ast_number(node));
                 break;
         case AST_NODE_KEYWORD:
-                fprintf(file, "%s", ast_keyword_string(ast_keyword(node)));
+                fprintf((FILE *)file, "%s", ast_keyword_string(ast_keyword(node)));
                 break;
         default:
                 assert(0);
                 break;
         }
 
-        if (node->right)
-                save_ast_tree(file, node->right);
+        return WALK_NEXT;
+}
 
-        fprintf(file, ")");
+static int save_close(ast_node *, void *file)
+{
+        fprintf((FILE *)file, ")");
+        return WALK_NEXT;
+}
+
+void save_ast_tree(FILE *file, ast_node *const node)
+{
+        assert(file);
+        assert(node);
+
+        ast_visitor saver = {};
+        saver.pre  = save_open;
+        saver.in   = save_data;
+        saver.post = save_close;
+        saver.ctx  = file;
+
+        walk_tree(node, &saver);
 }
 
 ast_node *set_ast_number(ast_node *n, double number)
@@ -70,6 +86,7 @@ ast_node *set_ast_number(ast_node *n, double number)
                 return nullptr;
 
         n->data.number = number;
+        n->hash = hash_ast_node(n);
         return n;
 }
 
@@ -82,6 +99,7 @@ ast_node *set_ast_ident(ast_node *n, const char *ident)
                 return nullptr;
 
         n->data.ident = ident;
+        n->hash = hash_ast_node(n);
         return n;
 }
 
@@ -94,6 +112,7 @@ ast_node *set_ast_keyword(ast_node *n, int keyword)
                 return nullptr;
 
         n->data.keyword = keyword;
+        n->hash = hash_ast_node(n);
         return n;
 }
 
@@ -130,48 +149,77 @@ int ast_keyword(ast_node *n)
         return 0;
 }
 
-ast_node *copy_tree(ast_node *n)
+/*
+ * Nodes on the walk path with their copies,
+ * the top one is the parent of the current node.
+ */
+struct copy_frame {
+        ast_node *node = nullptr;
+        ast_node *copy = nullptr;
+};
+
+static int copy_node(ast_node *node, void *ctx)
 {
-        assert(n);
+        array *path = (array *)ctx;
 
-        ast_node *newbie = create_ast_node(n->type);
+        ast_node *newbie = create_ast_node(node->type);
         if (!newbie)
-                return nullptr;
+                return WALK_STOP;
 
-        newbie->type = n->type;
-        newbie->data = n->data;
+        newbie->data = node->data;
+        newbie->hash = node->hash;
 
-        if (n->left) {
-                newbie->left  = copy_tree(n->left);
-                if (!newbie->left) {
-                        free_tree(newbie);
-                        return nullptr;
-                }
+        if (path->size) {
+                copy_frame *parent = (copy_frame *)array_top(path, sizeof(copy_frame));
+                if (parent->node->left == node && !parent->copy->left)
+                        parent->copy->left  = newbie;
+                else
+                        parent->copy->right = newbie;
         }
 
-        if (n->right) {
-                newbie->right = copy_tree(n->right);
-                if (!newbie->right) {
-                        free_tree(newbie);
-                        return nullptr;
-                }
-        }
+        copy_frame frame = { node, newbie };
+        if (!array_push(path, &frame, sizeof(copy_frame)))
+                return WALK_STOP;
 
-        return newbie;
+        return WALK_NEXT;
 }
 
+static int copy_done(ast_node *, void *ctx)
+{
+        array *path = (array *)ctx;
+
+        /* The root stays, its copy is the result */
+        if (path->size > 1)
+                array_pop(path, sizeof(copy_frame));
+
+        return WALK_NEXT;
+}
 
-void free_tree(ast_node *root)
+ast_node *copy_tree(ast_node *n)
 {
-        assert(root);
+        assert(n);
+
+        array path = {};
 
-        if (root->left)
-                free_tree(root->left);
-        if (root->right)
-                free_tree(root->right);
+        ast_visitor copier = {};
+        copier.pre  = copy_node;
+        copier.post = copy_done;
+        copier.ctx  = &path;
 
+        /* Partial copy stays in the arena until it is freed */
+        ast_node *root = nullptr;
+        if (!walk_tree(n, &copier))
+                root = ((copy_frame *)path.data)->copy;
 
-        free(root);
+        free_array(&path, sizeof(copy_frame));
+        return root;
+}
+
+
+void free_tree(arena *const nodes)
+{
+        assert(nodes);
+        free_arena(nodes);
 }
 
 ast_node *create_ast_keyword(int keyword) 
@@ -210,37 +258,290 @@ ast_node *create_ast_node(int type)
                type == AST_NODE_NUMBER  ||
                type == AST_NODE_KEYWORD );
 
-$       (ast_node *newbie = (ast_node *)calloc(1, sizeof(ast_node));)
+        arena *nodes = NODES ? NODES : &DEFAULT_NODES;
+
+        ast_node *newbie = (ast_node *)arena_alloc(nodes, sizeof(ast_node), alignof(ast_node));
         if (!newbie) {
                 fprintf(logs, "Can't create ast_node\n");
                 return nullptr;
         }
 
         newbie->type       = type;
-        newbie->hash       = 0x00000;
         newbie->left       = nullptr;
         newbie->right      = nullptr;
         newbie->data.ident = nullptr;
+        newbie->hash       = hash_ast_node(newbie);
+
+        return newbie;
+}
+
+static inline uint64_t data_bits(const ast_node *n)
+{
+        assert(n);
+
+        uint64_t bits = 0;
+        switch (n->type) {
+        case AST_NODE_KEYWORD:
+                return (uint32_t)n->data.keyword;
+        case AST_NODE_NUMBER:
+                /* Bitwise, so that 0 and -0 are different constants */
+                memcpy(&bits, &n->data.number, sizeof(bits));
+                return bits;
+        case AST_NODE_IDENT:
+                return (uintptr_t)n->data.ident;
+        default:
+                assert(0);
+                return 0;
+        }
+}
+
+static inline uint32_t mix_hash(uint32_t hash, uint64_t value)
+{
+        value ^= (uint64_t)hash * 0x9E3779B97F4A7C15ull;
+        value ^= value >> 33;
+        value *= 0xFF51AFD7ED558CCDull;
+        value ^= value >> 33;
+
+        return (uint32_t)value;
+}
+
+uint32_t hash_ast_node(const ast_node *n)
+{
+        assert(n);
+
+        uint32_t hash = (uint32_t)n->type;
+        hash = mix_hash(hash, data_bits(n));
+        hash = mix_hash(hash, n->left  ? n->left->hash  : 0);
+        hash = mix_hash(hash, n->right ? n->right->hash : 0);
+
+        return hash;
+}
+
+static int rehash_node(ast_node *node, void *)
+{
+        node->hash = hash_ast_node(node);
+        return WALK_NEXT;
+}
+
+void hash_tree(ast_node *root)
+{
+        assert(root);
+
+        ast_visitor hasher = {};
+        hasher.post = rehash_node;
+
+        walk_tree(root, &hasher);
+}
+
+ast_cons *use_ast_cons(ast_cons *const table)
+{
+        ast_cons *prev = CONS;
+        CONS = table;
+
+        return prev;
+}
+
+void free_ast_cons(ast_cons *const table)
+{
+        assert(table);
+
+        free(table->slots);
+        table->slots    = nullptr;
+        table->capacity = 0;
+        table->size     = 0;
+}
+
+static inline bool same_node(const ast_node *n1, const ast_node *n2)
+{
+        assert(n1);
+        assert(n2);
+
+        return n1->type  == n2->type  && data_bits(n1) == data_bits(n2) &&
+               n1->left  == n2->left  && n1->right     == n2->right;
+}
+
+static ast_node **find_cons_slot(ast_node **slots, size_t capacity,
+                                 const ast_node *value, uint32_t hash)
+{
+        assert(slots);
+        assert(value);
+
+        size_t mask = capacity - 1;
+        for (size_t i = hash & mask; ; i = (i + 1) & mask) {
+                ast_node *node = slots[i];
+                if (!node || (node->hash == hash && same_node(node, value)))
+                        return &slots[i];
+        }
+}
 
-        push_stack(&ALLOC, newbie);
+static int expand_cons(ast_cons *const table)
+{
+        assert(table);
+
+        size_t capacity = table->capacity ? table->capacity * 2 : 256;
+        ast_node **slots = (ast_node **)calloc(capacity, sizeof(ast_node *));
+        if (!slots) {
+                fprintf(logs, "Can't expand cons table\n");
+                return 1;
+        }
+
+        for (size_t i = 0; i < table->capacity; i++) {
+                ast_node *node = table->slots[i];
+                if (node)
+                        *find_cons_slot(slots, capacity, node, node->hash) = node;
+        }
+
+        free(table->slots);
+        table->slots    = slots;
+        table->capacity = capacity;
+
+        return 0;
+}
+
+ast_node *cons_ast_node(const ast_node *value)
+{
+        assert(value);
+
+        ast_node tmp = *value;
+        tmp.hash = hash_ast_node(&tmp);
+
+        ast_node **slot = nullptr;
+        if (CONS) {
+                /* Keep load factor below 1/2 */
+                if (CONS->size * 2 >= CONS->capacity && expand_cons(CONS))
+                        return nullptr;
+
+                slot = find_cons_slot(CONS->slots, CONS->capacity, &tmp, tmp.hash);
+                if (*slot)
+                        return *slot;
+        }
+
+        ast_node *newbie = create_ast_node(tmp.type);
+        if (!newbie)
+                return nullptr;
+
+        *newbie = tmp;
+        if (slot) {
+                *slot = newbie;
+                CONS->size++;
+        }
 
         return newbie;
 }
 
+ast_node *cons_ast_keyword(int keyword, ast_node *left, ast_node *right)
+{
+        ast_node value = {};
+        value.type         = AST_NODE_KEYWORD;
+        value.data.keyword = keyword;
+        value.left         = left;
+        value.right        = right;
+
+        return cons_ast_node(&value);
+}
+
+ast_node *cons_ast_number(double number)
+{
+        ast_node value = {};
+        value.type        = AST_NODE_NUMBER;
+        value.data.number = number;
+
+        return cons_ast_node(&value);
+}
+
+ast_node *cons_ast_ident(const char *ident, ast_node *right)
+{
+        assert(ident);
+
+        ast_node value = {};
+        value.type       = AST_NODE_IDENT;
+        value.data.ident = ident;
+        value.right      = right;
+
+        return cons_ast_node(&value);
+}
+
+ast_node *compare_trees(ast_node *t1, ast_node *t2)
+{
+        /* Pairs of subtrees left to compare */
+        array pairs = {};
+        ast_node *pair[2] = { t1, t2 };
+        ast_node *diff = nullptr;
+
+        while (true) {
+                t1 = pair[0];
+                t2 = pair[1];
+
+                if (t1 != t2) {
+                        if (!t1 || !t2) {
+                                diff = t1 ? t1 : t2;
+                                break;
+                        }
+
+                        if (t1->hash != t2->hash || t1->type != t2->type ||
+                            data_bits(t1) != data_bits(t2)) {
+                                diff = t1;
+                                break;
+                        }
+
+                        ast_node *right[2] = { t1->right, t2->right };
+                        if (!array_push(&pairs, right, sizeof(right))) {
+                                diff = t1;
+                                break;
+                        }
+
+                        pair[0] = t1->left;
+                        pair[1] = t2->left;
+                        continue;
+                }
+
+                if (!pairs.size)
+                        break;
+
+                memcpy(pair, array_top(&pairs, sizeof(pair)), sizeof(pair));
+                array_pop(&pairs, sizeof(pair));
+        }
+
+        free_array(&pairs, sizeof(pair));
+        return diff;
+}
+
+static int visit_node(ast_node *node, void *action)
+{
+        (*(void (**)(ast_node *))action)(node);
+        return WALK_NEXT;
+}
+
 void visit_tree(ast_node *root, void (*action)(ast_node *nd))
 {
         assert(root);
         assert(action);
 
-        if (!root)
-                return;
+        ast_visitor visitor = {};
+        visitor.pre = visit_node;
+        visitor.ctx = &action;
+
+        walk_tree(root, &visitor);
+}
+
+static int count_node(ast_node *, void *size)
+{
+        (*(size_t *)size)++;
+        return WALK_NEXT;
+}
+
+size_t calc_tree_size(ast_node *n)
+{
+        assert(n);
+
+        size_t size = 0;
 
-        action(root);
+        ast_visitor counter = {};
+        counter.pre = count_node;
+        counter.ctx = &size;
 
-        if (root->left)  
-                visit_tree(root->left, action);
-        if (root->right) 
-                visit_tree(root->right, action);
+        walk_tree(n, &counter);
+        return size;
 }
 
 
@@ -255,3 +556,25 @@ const char *ast_keyword_string(int id)
 
 #undef AST 
 }
+
+static constexpr phash_key AST_KEYS[] = {
+#define AST(name, keyword, str) { str, sizeof(str) - 1, AST_##name },
+#include "../AST"
+#undef AST
+};
+
+static constexpr size_t N_AST_KEYS = sizeof(AST_KEYS) / sizeof(phash_key);
+static_assert(N_AST_KEYS < PHASH_SIZE / 2, "Too many AST keywords");
+
+static constexpr phash_table AST_TABLE = make_phash_table(AST_KEYS, N_AST_KEYS);
+
+int find_ast_keyword(const char *str, size_t length)
+{
+        assert(str);
+
+        const phash_key *key = phash_find(&AST_TABLE, str, length);
+        if (!key)
+                return -1;
+
+        return key->id;
+}
@@ -0,0 +1,118 @@
+#include <stdio.h>
+#include <assert.h>
+#include <logs.h>
+#include <array.h>
+
+#include <ast/tree.h>
+#include <ast/flat.h>
+#include <ast/walk.h>
+
+template <typename node_t>
+struct walk_frame {
+        node_t *node = nullptr;
+        int    state = 0;
+};
+
+static inline ast_node *walk_left(const flat_tree *, ast_node *node)
+{
+        return node->left;
+}
+
+static inline ast_node *walk_right(const flat_tree *, ast_node *node)
+{
+        return node->right;
+}
+
+static inline const flat_node *walk_left(const flat_tree *flat, const flat_node *node)
+{
+        return flat_left(flat, node);
+}
+
+static inline const flat_node *walk_right(const flat_tree *flat, const flat_node *node)
+{
+        return flat_right(flat, node);
+}
+
+template <typename node_t, typename visitor_t>
+static int walk(const flat_tree *flat, node_t *root, const visitor_t *visitor)
+{
+        assert(root);
+        assert(visitor);
+
+        typedef walk_frame<node_t> frame;
+
+        array stack = {};
+        frame first = {};
+        first.node = root;
+
+        if (!array_push(&stack, &first, sizeof(frame))) {
+                fprintf(logs, "Can't start the walk\n");
+                return 1;
+        }
+
+        int error = 0;
+        while (stack.size) {
+                frame *top = (frame *)array_top(&stack, sizeof(frame));
+                node_t *node = top->node;
+                node_t *next = nullptr;
+                int action = WALK_NEXT;
+
+                switch (top->state++) {
+                case 0:
+                        if (visitor->pre)
+                                action = visitor->pre(node, visitor->ctx);
+
+                        if (action == WALK_SKIP) {
+                                array_pop(&stack, sizeof(frame));
+                                continue;
+                        }
+
+                        next = walk_left(flat, node);
+                        break;
+                case 1:
+                        if (visitor->in)
+                                action = visitor->in(node, visitor->ctx);
+
+                        if (action != WALK_SKIP)
+                                next = walk_right(flat, node);
+                        break;
+                default:
+                        if (visitor->post)
+                                action = visitor->post(node, visitor->ctx);
+
+                        array_pop(&stack, sizeof(frame));
+                        break;
+                }
+
+                if (action == WALK_STOP) {
+                        error = 1;
+                        break;
+                }
+
+                if (next) {
+                        frame child = {};
+                        child.node = next;
+
+                        if (!array_push(&stack, &child, sizeof(frame))) {
+                                fprintf(logs, "Can't grow the walk stack\n");
+                                error = 1;
+                                break;
+                        }
+                }
+        }
+
+        free_array(&stack, sizeof(frame));
+        return error;
+}
+
+int walk_tree(ast_node *root, const ast_visitor *visitor)
+{
+        return walk(nullptr, root, visitor);
+}
+
+int walk_flat_tree(const flat_tree *const flat, const flat_node *root,
+                   const flat_visitor *visitor)
+{
+        assert(flat);
+        return walk(flat, root, visitor);
+}
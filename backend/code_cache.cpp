@@ -0,0 +1,173 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <logs.h>
+#include <backend/code_cache.h>
+
+static const uint64_t CACHE_MAGIC = 0x31454843414341ull; /* "ACACHE1" */
+
+static const uint64_t FNV_OFFSET = 0xcbf29ce484222325ull;
+static const uint64_t FNV_PRIME  = 0x100000001b3ull;
+
+/*
+ * Entry file: the header, 'tree_size' bytes of the subtree
+ * and 'code_size' bytes of the code.
+ */
+struct cache_header {
+        uint64_t magic     = 0;
+        uint64_t context   = 0;
+        uint64_t tree_size = 0;
+        uint64_t code_size = 0;
+};
+
+static const size_t PATHSIZE = 1024;
+
+static const char *entry_path(char *path, const code_cache *const cache,
+                              const char *tree, size_t tree_size);
+
+int open_code_cache(code_cache *const cache, const char *dir)
+{
+        assert(cache);
+        assert(dir);
+
+        if (mkdir(dir, 0755) && errno != EEXIST) {
+                fprintf(stderr, ascii(red, "Can't create cache %s: %s\n"),
+                                dir, strerror(errno));
+                return EXIT_FAILURE;
+        }
+
+        cache->dir      = dir;
+        cache->context  = 0;
+        cache->n_hits   = 0;
+        cache->n_misses = 0;
+
+        return EXIT_SUCCESS;
+}
+
+uint64_t hash_bytes(uint64_t hash, const void *data, size_t size)
+{
+        assert(data);
+        const unsigned char *bytes = (const unsigned char *)data;
+
+        if (!hash)
+                hash = FNV_OFFSET;
+
+        for (size_t i = 0; i < size; i++) {
+                hash ^= bytes[i];
+                hash *= FNV_PRIME;
+        }
+
+        return hash;
+}
+
+bool find_cached_code(code_cache *const cache, const char *tree, size_t tree_size,
+                      FILE *out)
+{
+        assert(cache);
+        assert(tree);
+        assert(out);
+
+        char path[PATHSIZE] = {0};
+        if (!entry_path(path, cache, tree, tree_size))
+                return false;
+
+        FILE *entry = fopen(path, "rb");
+        if (!entry) {
+                __atomic_fetch_add(&cache->n_misses, 1, __ATOMIC_RELAXED);
+                return false;
+        }
+
+        cache_header header = {};
+        char *data = nullptr;
+        bool hit   = false;
+
+        if (fread(&header, sizeof(header), 1, entry) != 1 ||
+            header.magic     != CACHE_MAGIC    ||
+            header.context   != cache->context ||
+            header.tree_size != tree_size)
+                goto miss;
+
+        /* Same hash is not the same tree */
+        data = (char *)calloc(tree_size + header.code_size + 1, sizeof(char));
+        if (!data)
+                goto miss;
+
+        if (fread(data, sizeof(char), tree_size + header.code_size, entry) !=
+                                      tree_size + header.code_size ||
+            memcmp(data, tree, tree_size))
+                goto miss;
+
+        fwrite(data + tree_size, sizeof(char), header.code_size, out);
+        hit = true;
+
+miss:
+        free(data);
+        fclose(entry);
+
+        if (hit)
+                __atomic_fetch_add(&cache->n_hits, 1, __ATOMIC_RELAXED);
+        else
+                __atomic_fetch_add(&cache->n_misses, 1, __ATOMIC_RELAXED);
+
+        return hit;
+}
+
+int store_cached_code(code_cache *const cache, const char *tree, size_t tree_size,
+                      const char *code, size_t code_size)
+{
+        assert(cache);
+        assert(tree);
+        assert(code);
+
+        char path[PATHSIZE] = {0};
+        if (!entry_path(path, cache, tree, tree_size))
+                return EXIT_FAILURE;
+
+        /* Readers never see a half-written entry */
+        char temp[PATHSIZE] = {0};
+        int n = snprintf(temp, PATHSIZE, "%s.%d", path, getpid());
+        if (n < 0 || (size_t)n >= PATHSIZE)
+                return EXIT_FAILURE;
+
+        FILE *entry = fopen(temp, "wb");
+        if (!entry)
+                return EXIT_FAILURE;
+
+        cache_header header = {};
+        header.magic     = CACHE_MAGIC;
+        header.context   = cache->context;
+        header.tree_size = tree_size;
+        header.code_size = code_size;
+
+        bool written = fwrite(&header, sizeof(header), 1, entry) == 1 &&
+                       fwrite(tree, sizeof(char), tree_size, entry) == tree_size &&
+                       fwrite(code, sizeof(char), code_size, entry) == code_size;
+
+        if (fclose(entry) || !written || rename(temp, path)) {
+                remove(temp);
+                return EXIT_FAILURE;
+        }
+
+        return EXIT_SUCCESS;
+}
+
+static const char *entry_path(char *path, const code_cache *const cache,
+                              const char *tree, size_t tree_size)
+{
+        assert(path);
+        assert(cache);
+        assert(cache->dir);
+
+        uint64_t hash = hash_bytes(0, &cache->context, sizeof(cache->context));
+        hash = hash_bytes(hash, tree, tree_size);
+
+        int n = snprintf(path, PATHSIZE, "%s/%016lx.fn", cache->dir, hash);
+        if (n < 0 || (size_t)n >= PATHSIZE)
+                return nullptr;
+
+        return path;
+}
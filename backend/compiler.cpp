@@ -1,16 +1,30 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <math.h>
 #include <logs.h>
 #include <array.h>
 #include <iommap.h>
 #include <assert.h>
 #include <stack.h>
+#include <parallel.h>
 #include <ast/tree.h>
+#include <ast/flat.h>
+#include <ast/walk.h>
 #include <ast/keyword.h>
 #include <backend/scope_table.h>
+#include <backend/code_cache.h>
+#include <backend/ir.h>
+#include <backend/peephole.h>
+#include <backend/fold.h>
 #include <backend/backend.h>
 
-static int INDENT = 0;
+/*
+ * Functions are compiled on several threads, each of them
+ * emits its own code. Everything that changes while
+ * a function is compiled is thread-local.
+ */
+static thread_local int INDENT = 0;
 static int INDENT_SPACES = 4;
 
 static void indent()
@@ -23,47 +37,89 @@ static void unindent()
         INDENT -= INDENT_SPACES;
 }
 
+struct func_info {
+        const flat_node *node = nullptr;
+        const char *ident = 0;
+        size_t n_params   = 0;
+};
+
+/*
+ * Functions in source order, looked up in 'index'.
+ */
+struct func_table {
+        array funcs     = {};
+        ident_map index = {};
+};
+
 struct symbol_table {
         scope_table *local  = nullptr;
         scope_table *global = nullptr;
-        array       *func   = nullptr;
+        func_table  *func   = nullptr;
 };
 
-struct func_info {
-        ast_node    *node = nullptr;
-        const char *ident = 0;
-        size_t n_params   = 0;
+/*
+ * Function definition compiled by a worker into its own buffer.
+ */
+struct define_info {
+        const flat_node *node  = nullptr;
+        const flat_node *error = nullptr;
+
+        char  *code      = nullptr;
+        size_t code_size = 0;
 };
 
-static FILE *file = nullptr;
+struct define_job {
+        symbol_table *table = nullptr;
+        define_info  *defs  = nullptr;
+};
+
+static thread_local FILE *file = nullptr;
+static thread_local array *CODE = nullptr;
+static const flat_tree *TREE = nullptr;
+
+/*
+ * Function being compiled. Labels are numbered by the offset
+ * of the node in it, so the code of a function depends
+ * on nothing but its subtree and can be cached.
+ */
+static thread_local const flat_node *FUNC = nullptr;
+static thread_local const char *FUNC_NAME = nullptr;
+
+static const backend_options *OPTIONS = nullptr;
+
+static const int RETURN_REG = IR_AX;
+static const int GLOBAL_REG = IR_CX;
+static const int LOCAL_REG  = IR_BX;
+static const int SHIFT_REG  = IR_HX;
 
-static const size_t BUFSIZE = 128;
-static char BUFFER[BUFSIZE] = {0};
+/* The return value is pushed right after a call, expressions may use it */
+static const int TEMP_REG   = IR_AX;
 
-static const char *const RETURN_REG = "ax";
-static const char *const GLOBAL_REG = "cx";
-static const char *const LOCAL_REG  = "bx";
-static const char *const SHIFT_REG  = "hx";
+static const double MAX_POWER = 4;
 
-static int       keyword(ast_node *node);
-static double    *number(ast_node *node);
-static const char *ident(ast_node *node);
+static int keyword(const flat_node *node);
 
-static inline const char *number_str(double num);
+static inline ir_operand imm(double num);
+static inline ir_operand reg(int reg);
 
-static ast_node *success(ast_node *root);
-static ast_node *syntax_error(ast_node *root);
-static ast_node *dump_code(ast_node *root);
+static const flat_node *success(const flat_node *root);
+static const flat_node *syntax_error(const flat_node *root);
 
-static inline const char *id(const char *name, void *id);
+static inline ir_operand id(const char *name, const flat_node *node);
+static inline ir_operand func_label(const char *name);
+
+static inline const flat_node *left (const flat_node *node);
+static inline const flat_node *right(const flat_node *node);
+
+static var_info *add_variable(scope_table *const scope, const flat_node *variable);
 
 static void dump_array_function(void *item);
 
-static inline void LABEL(const char *arg);
+static inline void LABEL(ir_operand arg);
 static inline void WRITE(const char *arg);
 
 #define CMD(name, code, str, hash) \
-static inline void name(const char *arg = nullptr);
+static inline void name(ir_operand arg = {});
 #include <commands>
 #undef CMD
 
@@ -85,163 +141,217 @@ static inline void name(const char *arg = nullptr);
                 return syntax_error(root);         \
         } while (0)
 
-static inline const char  *local_variable(var_info *var, int memory = 1);
-static inline const char *global_variable(var_info *var, int memory = 1);
-
-static inline const char *memory(const char *reg, ptrdiff_t shift);
+/*
+ * Variables are memory operands, or their addresses without 'memory'.
+ * Operands of kind IR_ARG_NONE stand for errors.
+ */
+static inline ir_operand  local_variable(var_info *var, int memory = 1);
+static inline ir_operand global_variable(var_info *var, int memory = 1);
 
-static const char *create_variable(ast_node *variable, symbol_table *table);
-static const char *get_variable(ast_node *variable, symbol_table *table);
-static const char *find_variable(ast_node *variable, symbol_table *table, 
+static ir_operand create_variable(const flat_node *variable, symbol_table *table);
+static ir_operand get_variable(const flat_node *variable, symbol_table *table);
+static ir_operand find_variable(const flat_node *variable, symbol_table *table, 
                                                                 int memory = 1);
 
-static ast_node *declare_function(ast_node *root, array *const func_table);
+static const flat_node *declare_function(const flat_node *root, func_table *const funcs);
+
+static const flat_node *compile_shift(const flat_node *variable, symbol_table *table);
+
+static const flat_node *compile_return(const flat_node *root, symbol_table *table);
+static const flat_node *compile_define(const flat_node *root, symbol_table *table);
+static const flat_node *compile_cached  (define_info *def, symbol_table *table);
+static const flat_node *compile_function(const flat_node *root, symbol_table *table);
+static const flat_node *compile_stmt  (const flat_node *root, symbol_table *table);
+static const flat_node *compile_assign(const flat_node *root, symbol_table *table);
+static const flat_node *compile_expr  (const flat_node *root, symbol_table *table);
+static const flat_node *compile_reduced(const flat_node *root, symbol_table *table);
+static const flat_node *compile_if    (const flat_node *root, symbol_table *table);
+static const flat_node *compile_while (const flat_node *root, symbol_table *table);
+static const flat_node *compile_call  (const flat_node *root, symbol_table *table);
 
-static ast_node *compile_shift(ast_node *variable, symbol_table *table);
+/*
+ * Statements, parameters and arguments are lists chained
+ * through 'left', the items hang on 'right'. walk_spine()
+ * checks the keyword of every list node and passes items
+ * to 'item' in order, without recursion.
+ */
+typedef const flat_node *(*item_compiler)(const flat_node *root, void *arg);
 
-static ast_node *compile_return(ast_node *root, symbol_table *table);
-static ast_node *compile_define(ast_node *root, symbol_table *table);
-static ast_node *compile_stmt  (ast_node *root, symbol_table *table);
-static ast_node *compile_assign(ast_node *root, symbol_table *table);
-static ast_node *compile_expr  (ast_node *root, symbol_table *table);
-static ast_node *compile_if    (ast_node *root, symbol_table *table);
-static ast_node *compile_while (ast_node *root, symbol_table *table);
-static ast_node *compile_call  (ast_node *root, symbol_table *table);
+static const flat_node *walk_spine(const flat_node *root, int list_keyword,
+                                   item_compiler item, void *arg);
 
-static ast_node *main_branch_assign(ast_node *root, symbol_table *table);
-static ast_node *declare_function_variable(ast_node *root, symbol_table *table);
+static func_info *find_function  (const flat_node *call, func_table *const funcs);
+static const flat_node *create_func_table(const flat_node *root, func_table *const funcs);
 
-static func_info *find_function  (ast_node *call, array *const func_table);
-static ast_node *declare_function (ast_node *root, array *const func_table);
-static ast_node *create_func_table(ast_node *root, array *const func_table);
+static const flat_node *create_global_table(const flat_node *root, symbol_table *table);
+static const flat_node *create_local_table (const flat_node *root, symbol_table *table);
 
-static ast_node *create_global_table(ast_node *root, symbol_table *table);
-static ast_node *create_local_table (ast_node *root, symbol_table *table);
+static uint64_t hash_context(symbol_table *table);
+static void optimize_code(array *const code);
 
-int compile_tree(FILE *output, ast_node *tree)
+int compile_tree(FILE *output, const flat_tree *flat, const backend_options *options)
 {
         assert(output);
-        assert(tree);
+        assert(flat);
+        assert(options);
+        assert(options->n_threads);
 
         int ret = EXIT_SUCCESS;
-        file = output;
+        file    = output;
+        OPTIONS = options;
+
+        flat_tree folded = {};
+        if (options->optimize) {
+                if (fold_constants(flat, &folded)) {
+                        free_flat_tree(&folded);
+                        return EXIT_FAILURE;
+                }
+
+                flat = &folded;
+        }
+
+        TREE = flat;
 
-        array func_table = {0};
+        const flat_node *tree = flat_root(flat);
+        if (!tree) {
+                free_flat_tree(&folded);
+                return EXIT_FAILURE;
+        }
+
+        array code = {0};
+        CODE = &code;
+
+        func_table funcs = {};
         array global     = {0};
         scope_table gst  = {0};
 
         gst.entries  = &global;
 
-        create_func_table(tree, &func_table);
+        create_func_table(tree, &funcs);
         /* Check for main */
-        dump_array(&func_table, sizeof(func_info), dump_array_function);
+        dump_array(&funcs.funcs, sizeof(func_info), dump_array_function);
 
         symbol_table tab = {0};
-        tab.func   = &func_table;
+        tab.func   = &funcs;
         tab.local  = &gst;
         tab.global = &gst;
 
         create_global_table(tree, &tab);
+        if (options->cache)
+                options->cache->context = hash_context(&tab);
 
-        PUSH(number_str(tab.global->shift));
-        PUSH(LOCAL_REG);
+        PUSH(imm((double)tab.global->shift));
+        PUSH(reg(LOCAL_REG));
         ADD();
-        POP(LOCAL_REG);
-        CALL("main\n\n");
+        POP(reg(LOCAL_REG));
+        CALL(func_label("main"));
+        WRITE("");
+        WRITE("");
         HLT();
 
-        ast_node *err = compile_define(tree, &tab);
+        optimize_code(CODE);
+        if (print_ir(file, &code))
+                ret = EXIT_FAILURE;
+
+        const flat_node *err = compile_define(tree, &tab);
         if (err) {
                ret = EXIT_FAILURE; 
         }
 
-        free_array(&func_table, sizeof(func_info));
+        CODE = nullptr;
+        free_array(&code, sizeof(ir_instr));
+
+        free_array(&funcs.funcs, sizeof(func_info));
+        free_ident_map(&funcs.index);
+
         free_array(gst.entries, sizeof(var_info));
+        free_scope_table(&gst);
+        free_flat_tree(&folded);
 
         return ret;
 }
 
-static ast_node *compile_return(ast_node *root, symbol_table *table)
+static const flat_node *compile_return(const flat_node *root, symbol_table *table)
 {
         assert(root);
         assert(table);
-        ast_node *error = nullptr;
+        const flat_node *error = nullptr;
 $$
         require(root, AST_RETURN);
-        if (!root->right)
+        if (!right(root))
                 return syntax_error(root);
 $$
-        error = compile_expr(root->right, table);
+        error = compile_expr(right(root), table);
 $$
         if (error)
                 return error;
 $$
-        POP(RETURN_REG);
+        POP(reg(RETURN_REG));
         RET();
 $$
         return success(root);
 }
 
-static ast_node *compile_show(ast_node *root, symbol_table *table)
+static const flat_node *compile_show(const flat_node *root, symbol_table *table)
 {
         assert(root);
         assert(table);
-        ast_node *error = nullptr;
+        const flat_node *error = nullptr;
 $$
         require(root, AST_SHOW);
 $$
-        const char *ident = find_variable(root->left, table, 0);
+        ir_operand ident = find_variable(left(root), table, 0);
 $$
-        if (!ident)
+        if (!ident.kind)
                 return syntax_error(root);
 
         PUSH(ident);
-        error = compile_expr(root->right, table);
+        error = compile_expr(right(root), table);
 $$
         SHW();
 $$
         return success(root);
 }
 
-static ast_node *compile_if(ast_node *root, symbol_table *table)
+static const flat_node *compile_if(const flat_node *root, symbol_table *table)
 {
         assert(root);
         assert(table);
-        ast_node *error = nullptr;
+        const flat_node *error = nullptr;
 $$
         require(root, AST_IF);
 $$
         WRITE("; IF");
 
         indent();
-        error = compile_expr(root->left, table);
+        error = compile_expr(left(root), table);
 $$
         if (error)
                 return error;
 
-        PUSH("0");
+        PUSH(imm(0));
         JE(id("if_fail", root));
 $$
-        ast_node *decision = root->right;
+        const flat_node *decision = right(root);
         if (!decision)
                 return syntax_error(root);
 $$
 
-        if (!decision->left)
+        if (!left(decision))
                 return syntax_error(root);
 
 $$
-        error = compile_stmt(decision->left, table);
+        error = compile_stmt(left(decision), table);
         if (error)
                 return error;
 $$
 
-        if (decision->right) {
+        if (right(decision)) {
                 JMP(id("if_end", root));
                 LABEL(id("if_fail", root));
 $$
 
-                error = compile_stmt(decision->right, table);
+                error = compile_stmt(right(decision), table);
 $$
                 if (error)
                         return error;
@@ -255,11 +365,11 @@ $$
         return success(root);
 }
 
-static ast_node *compile_while(ast_node *root, symbol_table *table)
+static const flat_node *compile_while(const flat_node *root, symbol_table *table)
 {
         assert(root);
         assert(table);
-        ast_node *error = nullptr;
+        const flat_node *error = nullptr;
 $$
         require(root, AST_WHILE);
 $$
@@ -269,18 +379,18 @@ $$
         LABEL(id("while", root));
         indent();
 $$
-        if (!root->left)
+        if (!left(root))
                 return syntax_error(root);
 
-        error = compile_expr(root->left, table);
+        error = compile_expr(left(root), table);
 $$
         if (error)
                 return error;
 
-        PUSH("0");
+        PUSH(imm(0));
         JE(id("while_end", root));
 
-        error = compile_stmt(root->right, table);
+        error = compile_stmt(right(root), table);
 $$
         if (error)
                 return error;
@@ -292,28 +402,92 @@ $$
         return success(root);
 }
 
-static ast_node *compile_define(ast_node *root, symbol_table *table)
+static const flat_node *define_item(const flat_node *root, void *arg)
 {
         assert(root);
-        assert(table);
-        ast_node *error = nullptr;
-$$
-        if (root->left) {
-$$
-                error = compile_define(root->left, table);
+        assert(arg);
 $$
-                if (error) {
+        if (keyword(right(root)) != AST_DEFINE)
+                return success(root);
 $$
-                        return error;
+        define_info info = {};
+        info.node = right(root);
+
+        array_push((array *)arg, &info, sizeof(define_info));
+        return success(root);
+}
+
+static void define_task(void *arg, size_t index)
+{
+        assert(arg);
+        define_job  *job = (define_job *)arg;
+        define_info *def = &job->defs[index];
+
+        /* Only the local scope is changed */
+        symbol_table table = *job->table;
+
+        FILE *output = file;
+        file = open_memstream(&def->code, &def->code_size);
+        if (!file) {
+                file = output;
+                def->error = syntax_error(def->node);
+                return;
+        }
+
+        array code = {0};
+        array *outer = CODE;
+        CODE = &code;
+
+        def->error = compile_cached(def, &table);
+
+        CODE = outer;
+        free_array(&code, sizeof(ir_instr));
+
+        fclose(file);
+        file = output;
+}
+
+static const flat_node *compile_cached(define_info *def, symbol_table *table)
+{
+        assert(def);
+        assert(table);
+        const flat_node *error = nullptr;
+$$
+        char  *tree = nullptr;
+        size_t tree_size = 0;
+        FILE *mem = OPTIONS->cache ? open_memstream(&tree, &tree_size) : nullptr;
+        if (mem) {
+                save_flat_tree(mem, TREE, def->node);
+                fclose(mem);
+
+                if (find_cached_code(OPTIONS->cache, tree, tree_size, file)) {
+                        free(tree);
+                        return success(def->node);
                 }
         }
+
+        error = compile_function(def->node, table);
+        if (!error)
+                optimize_code(CODE);
+
+        if (print_ir(file, CODE) && !error)
+                error = syntax_error(def->node);
+
+        /* Flushing updates the code written so far */
+        if (tree && !error && !fflush(file))
+                store_cached_code(OPTIONS->cache, tree, tree_size, def->code, def->code_size);
+
+        free(tree);
+        return error;
+}
+
+static const flat_node *compile_function(const flat_node *root, symbol_table *table)
+{
+        assert(root);
+        assert(table);
+        const flat_node *error = nullptr;
 $$
-        if (keyword(root->right) != AST_DEFINE)
-                return success(root);
-$$
-        ast_node *define = root->right;
-$$
-        if (!define->right)
+        if (!right(root))
                 return syntax_error(root);
 $$
         scope_table local = {0};
@@ -323,124 +497,149 @@ $$
         table->local = &local;
 
 $$
-        require(define->left, AST_FUNC);
+        require(left(root), AST_FUNC);
 $$
-        if (define->left->right) {
-                error = create_local_table(define->left->right, table);
+        if (right(left(root))) {
+                error = create_local_table(right(left(root)), table);
 $$
                 if (error)
                         return error;
         }
 $$
-        ast_node *name = define->left->left;
+        const flat_node *name = left(left(root));
         require_ident(name);
+
+        FUNC      = root;
+        FUNC_NAME = flat_ident(TREE, name);
 $$
-        LABEL(ast_ident(name));
+        LABEL(func_label(FUNC_NAME));
         indent();
 $$
-        error = compile_stmt(define->right, table);
+        error = compile_stmt(right(root), table);
         unindent();
 $$
         if (!error)
                 dump_array(&entries, sizeof(var_info), dump_array_var_info);
 $$
         free_array(&entries, sizeof(var_info));
+        free_scope_table(&local);
 $$
         table->local = nullptr;
 $$
         return error;
 }
 
-static ast_node *compile_stmt(ast_node *root, symbol_table *table)
+/*
+ * Function bodies are compiled in parallel, the code
+ * is written in source order. As before, nothing is written
+ * after the first function that fails.
+ */
+static const flat_node *compile_define(const flat_node *root, symbol_table *table)
 {
         assert(root);
         assert(table);
-        ast_node *error = nullptr;
-$$
-        require(root, AST_STMT);
-$$
-        if (root->left) {
 $$
-                error = compile_stmt(root->left, table);
-$$
-                if (error)
-                        return error;
+        array defs = {0};
+        const flat_node *error = walk_spine(root, 0, define_item, &defs);
+
+        define_job job = {};
+        job.table = table;
+        job.defs  = (define_info *)defs.data;
+
+        if (!error)
+                parallel_for(defs.size, OPTIONS->n_threads, define_task, &job);
+
+        for (size_t i = 0; i < defs.size; i++) {
+                if (!error && job.defs[i].code)
+                        fwrite(job.defs[i].code, sizeof(char), job.defs[i].code_size, file);
+                if (!error)
+                        error = job.defs[i].error;
+
+                free(job.defs[i].code);
         }
+
+        free_array(&defs, sizeof(define_info));
+        return error;
+}
+
+static const flat_node *stmt_item(const flat_node *root, void *arg)
+{
+        assert(root);
+        assert(arg);
+        symbol_table *table = (symbol_table *)arg;
+        const flat_node *error = nullptr;
 $$
-        if (!root->right)
-                return syntax_error(root);
-$$
-        if (!keyword(root))
+        if (!right(root))
                 return syntax_error(root);
 $$
-        switch (ast_keyword(root->right)) {
+        switch (flat_keyword(right(root))) {
         case AST_ASSIGN:
-                return compile_assign(root->right, table);
+                return compile_assign(right(root), table);
         case AST_IF:
-                return compile_if(root->right, table);
+                return compile_if(right(root), table);
         case AST_WHILE:
-                return compile_while(root->right, table);
+                return compile_while(right(root), table);
         case AST_SHOW:
-                return compile_show(root->right, table);
+                return compile_show(right(root), table);
         case AST_CALL:
-                error = compile_call(root->right, table);
+                error = compile_call(right(root), table);
                 if (error)
                         return error;
                 POP();
                 return success(root);
         case AST_OUT:
-                error = compile_expr(root->right->right, table);
+                error = compile_expr(right(right(root)), table);
                 if (error)
                         return error;
                 OUT();
                 return success(root);
         case AST_RETURN:
-                return compile_return(root->right, table);
+                return compile_return(right(root), table);
         default:
                 return syntax_error(root);
         }
 }
 
-static ast_node *create_local_table(ast_node *root, symbol_table *table)
+static const flat_node *compile_stmt(const flat_node *root, symbol_table *table)
 {
         assert(root);
         assert(table);
-        ast_node *error = nullptr;
-$$
-        require(root, AST_PARAM);
 $$
-        if (root->left) {
-$$
-                error = create_local_table(root->left, table);
-$$
-                if (error)
-                        return error;
-        }
+        return walk_spine(root, AST_STMT, stmt_item, table);
+}
+
+static const flat_node *local_item(const flat_node *root, void *arg)
+{
+        assert(root);
+        assert(arg);
+        symbol_table *table = (symbol_table *)arg;
 $$
-        require_ident(root->right);
+        require_ident(right(root));
 $$
-        const char *ident = create_variable(root->right, table);
+        ir_operand ident = create_variable(right(root), table);
 $$
-        if (!ident)
+        if (!ident.kind)
                 return syntax_error(root);
 $$
         return success(root);
 }
 
-static ast_node *compile_param(ast_node *root, symbol_table *table, ptrdiff_t n_args = 0)
+static const flat_node *create_local_table(const flat_node *root, symbol_table *table)
 {
         assert(root);
         assert(table);
-        ast_node *error = nullptr;
 $$
-        if (root->left) {
-$$
-                error = compile_param(root->left, table, n_args - 1);
-                if (error)
-                        return error;
-        }
+        return walk_spine(root, AST_PARAM, local_item, table);
+}
+
+static const flat_node *param_item(const flat_node *root, void *arg)
+{
+        assert(root);
+        assert(arg);
+        symbol_table *table = (symbol_table *)arg;
+        const flat_node *error = nullptr;
 $$
-        error = compile_expr(root->right, table);
+        error = compile_expr(right(root), table);
         if (error)
                 return error;
 $$
@@ -450,33 +649,40 @@ $$
                 return syntax_error(root);
 
 $$
-        const char *ident = local_variable(param);
-        POP(ident);
+        /* The expression leaves its last index in the shift register */
+        PUSH(imm(0));
+        POP(reg(SHIFT_REG));
+        POP(local_variable(param));
 $$
 
         return success(root);
 }
 
-static ast_node *compile_call(ast_node *root, symbol_table *table)
+static const flat_node *compile_param(const flat_node *root, symbol_table *table)
 {
         assert(root);
         assert(table);
-        ast_node *error = nullptr;
+$$
+        return walk_spine(root, 0, param_item, table);
+}
+
+static const flat_node *compile_call(const flat_node *root, symbol_table *table)
+{
+        assert(root);
+        assert(table);
+        const flat_node *error = nullptr;
 $$
         require(root, AST_CALL);
-        save_ast_tree(stderr, root);
 $$
-        func_info *func = find_function(root->left, table->func);
+        func_info *func = find_function(left(root), table->func);
         if (!func)
                 return syntax_error(root);
-$$
-        dump_code(root);
 $$
         size_t n_params = 0;
-        ast_node *param = root->right;
+        const flat_node *param = right(root);
         while (param) {
 $$
-                param = param->left;
+                param = left(param);
                 n_params++;
         }
 $$
@@ -484,9 +690,9 @@ $$
                 return syntax_error(root);
 $$
 
-        if (root->right) {
+        if (right(root)) {
 $$
-                error = compile_param(root->right, table, func->n_params - 1);
+                error = compile_param(right(root), table);
                 if (error)
                         return error;
         }
@@ -500,58 +706,43 @@ $$
         $(dump_array(table->local->entries, sizeof(var_info), dump_array_var_info);)
 $$
 
-        PUSH(LOCAL_REG);
-        PUSH(number_str(table->local->shift));
+        PUSH(reg(LOCAL_REG));
+        PUSH(imm((double)table->local->shift));
         ADD();
-        POP(LOCAL_REG);
+        POP(reg(LOCAL_REG));
 $$
 
-        CALL(func->ident);
-        PUSH(RETURN_REG);
+        CALL(func_label(func->ident));
+        PUSH(reg(RETURN_REG));
 $$
 
-        PUSH(LOCAL_REG);
-        PUSH(number_str(table->local->shift));
+        PUSH(reg(LOCAL_REG));
+        PUSH(imm((double)table->local->shift));
         SUB();
-        POP(LOCAL_REG);
+        POP(reg(LOCAL_REG));
 $$
         return success(root);
 }
 
-static ast_node *compile_expr(ast_node *root, symbol_table *table) 
+static const flat_node *compile_operand(const flat_node *root, symbol_table *table)
 {
         assert(root);
         assert(table);
-        ast_node *error = nullptr;
 $$
         if (keyword(root) == AST_CALL)
                 return compile_call(root, table);
 $$
-        if (keyword(root)) {
-                if (root->left) {
-                        error = compile_expr(root->left, table);
-                        if (error)
-                                return error;
-                }
-$$
-                if (root->right) {
-                        error = compile_expr(root->right, table);
-                        if (error)
-                                return error;
-                }
-        }
-$$
-        const char *ident = nullptr;
+        ir_operand ident = {};
         switch (root->type) {
         case AST_NODE_NUMBER:
 $$
-                PUSH(number_str(ast_number(root)));
+                PUSH(imm(*flat_number(TREE, root)));
                 return success(root);
         case AST_NODE_IDENT:
 $$
                 require_ident(root);
                 ident = find_variable(root, table);
-                if (!ident)
+                if (!ident.kind)
                         return syntax_error(root);
 $$
                 PUSH(ident);
@@ -559,7 +750,13 @@ $$
         default:
                 break;
         }
+$$
+        return syntax_error(root);
+}
 
+static const flat_node *compile_operator(const flat_node *root)
+{
+        assert(root);
 $$
         switch (keyword(root)) {
         case AST_ADD:
@@ -623,51 +820,226 @@ $$
         return syntax_error(root);
 }
 
-static ast_node *compile_assign(ast_node *root, symbol_table *table)
+/*
+ * Comparisons and logic give 1 or 0.
+ */
+static bool integral(const flat_node *node)
+{
+        assert(node);
+
+        double num = 0;
+        switch (keyword(node)) {
+        case AST_EQUAL:
+        case AST_NEQUAL:
+        case AST_GREAT:
+        case AST_LOW:
+        case AST_GEQUAL:
+        case AST_LEQUAL:
+        case AST_NOT:
+        case AST_AND:
+        case AST_OR:
+        case AST_INT:
+                return true;
+        default:
+                break;
+        }
+
+        if (node->type != AST_NODE_NUMBER)
+                return false;
+
+        num = *flat_number(TREE, node);
+        return fpclassify(num - trunc(num)) == FP_ZERO;
+}
+
+/*
+ * Small integer powers are multiplied out,
+ * int() of an integer is dropped.
+ */
+static bool reducible(const flat_node *node)
+{
+        assert(node);
+
+        const flat_node *power = nullptr;
+        switch (keyword(node)) {
+        case AST_POW:
+                power = right(node);
+                return left(node) && power && power->type == AST_NODE_NUMBER &&
+                       integral(power) && *flat_number(TREE, power) >= 0 &&
+                       *flat_number(TREE, power) <= MAX_POWER;
+        case AST_INT:
+                return right(node) && integral(right(node));
+        default:
+                return false;
+        }
+}
+
+static void square()
+{
+        POP(reg(TEMP_REG));
+        PUSH(reg(TEMP_REG));
+        PUSH(reg(TEMP_REG));
+        MUL();
+}
+
+/*
+ * Numbers and variables are pushed again, anything
+ * else is kept in the register.
+ */
+static const flat_node *multiply(const flat_node *base, symbol_table *table)
+{
+        assert(base);
+        assert(table);
+        const flat_node *error = nullptr;
+
+        if (keyword(base) || left(base) || right(base)) {
+                PUSH(reg(TEMP_REG));
+        } else {
+                error = compile_expr(base, table);
+                if (error)
+                        return error;
+        }
+
+        MUL();
+        return success(base);
+}
+
+static const flat_node *compile_reduced(const flat_node *root, symbol_table *table)
 {
         assert(root);
         assert(table);
-        ast_node *error = nullptr;
+        const flat_node *error = nullptr;
 $$
-        require(root, AST_ASSIGN);
+        if (keyword(root) == AST_INT)
+                return compile_expr(right(root), table);
 $$
-        dump_code(root);
+        const flat_node *base = left(root);
+        int power = (int)*flat_number(TREE, right(root));
 
-        error = compile_expr(root->right, table);
+        error = compile_expr(base, table);
         if (error)
                 return error;
+
+        if (power >= 2 && (keyword(base) || left(base) || right(base))) {
+                POP(reg(TEMP_REG));
+                PUSH(reg(TEMP_REG));
+        }
 $$
-        require_ident(root->left);
-$$
-        const char *ident = get_variable(root->left, table);
-        if (!ident)
+        switch (power) {
+        case 0:
+                POP();
+                PUSH(imm(1));
+                break;
+        case 1:
+                break;
+        case 2:
+                error = multiply(base, table);
+                break;
+        case 3:
+                error = multiply(base, table);
+                if (!error)
+                        error = multiply(base, table);
+                break;
+        case 4:
+                error = multiply(base, table);
+                square();
+                break;
+        default:
                 return syntax_error(root);
+        }
 $$
-        POP(ident);
+        return error;
+}
+
+struct expr_compiler {
+        symbol_table *table    = nullptr;
+        const flat_node *error = nullptr;
+};
+
+static int expr_node(const flat_node *node, void *ctx)
+{
+        expr_compiler *compiler = (expr_compiler *)ctx;
+
+        if (OPTIONS->optimize && reducible(node)) {
+                compiler->error = compile_reduced(node, compiler->table);
+                return compiler->error ? WALK_STOP : WALK_SKIP;
+        }
+
+        /* Operators take their operands from the stack, compile them first */
+        if (keyword(node) && keyword(node) != AST_CALL)
+                return WALK_NEXT;
+
+        compiler->error = compile_operand(node, compiler->table);
+        if (compiler->error)
+                return WALK_STOP;
+
+        return WALK_SKIP;
+}
+
+static int expr_done(const flat_node *node, void *ctx)
+{
+        expr_compiler *compiler = (expr_compiler *)ctx;
+
+        compiler->error = compile_operator(node);
+        if (compiler->error)
+                return WALK_STOP;
+
+        return WALK_NEXT;
+}
+
+static const flat_node *compile_expr(const flat_node *root, symbol_table *table) 
+{
+        assert(root);
+        assert(table);
 $$
-        return success(root);
+        expr_compiler compiler = {};
+        compiler.table = table;
+
+        flat_visitor visitor = {};
+        visitor.pre  = expr_node;
+        visitor.post = expr_done;
+        visitor.ctx  = &compiler;
+
+        if (walk_flat_tree(TREE, root, &visitor) && !compiler.error)
+                return syntax_error(root);
+
+        return compiler.error;
 }
 
-static ast_node *create_global_table(ast_node *root, symbol_table *table)
+static const flat_node *compile_assign(const flat_node *root, symbol_table *table)
 {
         assert(root);
         assert(table);
-        ast_node *error = nullptr;
+        const flat_node *error = nullptr;
 $$
-        require(root, AST_STMT);
+        require(root, AST_ASSIGN);
 $$
-        if (root->left) {
-                error = create_global_table(root->left, table);
-                if (error)
-                        return error;
-        }
+        error = compile_expr(right(root), table);
+        if (error)
+                return error;
+$$
+        require_ident(left(root));
+$$
+        ir_operand ident = get_variable(left(root), table);
+        if (!ident.kind)
+                return syntax_error(root);
+$$
+        POP(ident);
+$$
+        return success(root);
+}
 
+static const flat_node *global_item(const flat_node *root, void *arg)
+{
+        assert(root);
+        assert(arg);
+        symbol_table *table = (symbol_table *)arg;
+        const flat_node *error = nullptr;
 $$
-        if (keyword(root->right) != AST_ASSIGN)
+        if (keyword(right(root)) != AST_ASSIGN)
                 return success(root); 
 
 $$
-        error = compile_assign(root->right, table);
+        error = compile_assign(right(root), table);
         if (error)
                 return error;
 
@@ -675,13 +1047,21 @@ $$
         return success(root);
 }
 
-static ast_node *declare_function(ast_node *root, array *const func_table)
+static const flat_node *create_global_table(const flat_node *root, symbol_table *table)
 {
         assert(root);
+        assert(table);
+$$
+        return walk_spine(root, AST_STMT, global_item, table);
+}
 
+static const flat_node *declare_function(const flat_node *root, func_table *const funcs)
+{
+        assert(root);
+        assert(funcs);
 $$
-        ast_node *func = root->left;
-        func_info *exist = find_function(func->left, func_table);
+        const flat_node *func = left(root);
+        func_info *exist = find_function(left(func), funcs);
         if (exist)
                 return syntax_error(root);
 $$
@@ -689,117 +1069,183 @@ $$
         func_info info = {0};
 $$
         info.node = func;
-        info.ident = ast_ident(func->left);
+        info.ident = flat_ident(TREE, left(func));
         info.n_params = 0;
 $$
 
-        ast_node *param = func->right;
+        const flat_node *param = right(func);
         while (param) {
                 info.n_params++;
-                param = param->left;
+                param = left(param);
         }
 $$
 
-        array_push(func_table, &info, sizeof(func_info));
+        if (!array_push(&funcs->funcs, &info, sizeof(func_info)))
+                return syntax_error(root);
+
+        if (ident_map_add(&funcs->index, info.ident, funcs->funcs.size - 1))
+                return syntax_error(root);
+
         return success(root);
 }
 
-static ast_node *create_func_table(ast_node *root, array *const func_table)
+static const flat_node *func_item(const flat_node *root, void *arg)
 {
         assert(root);
-        assert(func_table);
-        ast_node *error = nullptr;
-$$
-        if (keyword(root) != AST_STMT)
-                return syntax_error(root);
+        assert(arg);
 $$
-        if (root->left) {
-                error = create_func_table(root->left, func_table);
-                if (error)
-                        return error;
-        }
+        if (keyword(right(root)) != AST_DEFINE)
+                return success(root);
 
 $$
-        if (keyword(root->right) != AST_DEFINE)
-                return success(root);
+        return declare_function(right(root), (func_table *)arg);
+}
 
+static const flat_node *create_func_table(const flat_node *root, func_table *const funcs)
+{
+        assert(root);
+        assert(funcs);
 $$
-        return declare_function(root->right, func_table);
+        return walk_spine(root, AST_STMT, func_item, funcs);
 }
 
+struct spine_walker {
+        int list_keyword   = 0;
+        item_compiler item = nullptr;
+        void *arg          = nullptr;
+
+        const flat_node *error = nullptr;
+};
 
-static ast_node *syntax_error(ast_node *root)
+static int spine_node(const flat_node *node, void *ctx)
+{
+        spine_walker *walker = (spine_walker *)ctx;
+
+        if (walker->list_keyword && keyword(node) != walker->list_keyword) {
+                walker->error = syntax_error(node);
+                return WALK_STOP;
+        }
+
+        return WALK_NEXT;
+}
+
+static int spine_item(const flat_node *node, void *ctx)
+{
+        spine_walker *walker = (spine_walker *)ctx;
+
+        walker->error = walker->item(node, walker->arg);
+        if (walker->error)
+                return WALK_STOP;
+
+        /* Items are compiled by 'item', the walk goes down the list only */
+        return WALK_SKIP;
+}
+
+static const flat_node *walk_spine(const flat_node *root, int list_keyword,
+                                   item_compiler item, void *arg)
 {
         assert(root);
-        fprintf(stderr, ascii(red, "Syntax error:\n"));
-        save_ast_tree(stderr, root);
-        $(dump_tree(root);)
-        fprintf(stderr, "\n");
-        return root;
+        assert(item);
+
+        spine_walker walker = {};
+        walker.list_keyword = list_keyword;
+        walker.item = item;
+        walker.arg  = arg;
+
+        flat_visitor visitor = {};
+        visitor.pre = spine_node;
+        visitor.in  = spine_item;
+        visitor.ctx = &walker;
+
+        if (walk_flat_tree(TREE, root, &visitor) && !walker.error)
+                return syntax_error(root);
+
+        return walker.error;
 }
 
-static ast_node *dump_code(ast_node *root)
+
+static const flat_node *syntax_error(const flat_node *root)
 {
         assert(root);
-        fprintf(stderr, ";");
-        save_ast_tree(stderr, root);
+        fprintf(stderr, ascii(red, "Syntax error:\n"));
+        save_flat_tree(stderr, TREE, root);
+        $(save_flat_tree(logs, TREE, root);)
         fprintf(stderr, "\n");
         return root;
 }
 
-static ast_node *success(ast_node *root)
+static const flat_node *success(const flat_node *root)
 {
         return nullptr;
 }
 
 
-static int keyword(ast_node *node)
+static int keyword(const flat_node *node)
 {
         assert(node);
 
         if (node->type == AST_NODE_KEYWORD)
-                return ast_keyword(node);
+                return flat_keyword(node);
 
         return 0;
 }
 
-static func_info *find_function(ast_node *name, array *const func_table)
+static inline const flat_node *left(const flat_node *node)
+{
+        return flat_left(TREE, node);
+}
+
+static inline const flat_node *right(const flat_node *node)
+{
+        return flat_right(TREE, node);
+}
+
+static var_info *add_variable(scope_table *const scope, const flat_node *variable)
+{
+        assert(scope);
+        assert(variable);
+
+        ptrdiff_t length = 0;
+        if (right(variable))
+                length = (ptrdiff_t)*flat_number(TREE, right(variable));
+
+        return scope_table_add(scope, variable, flat_ident(TREE, variable), length);
+}
+
+static func_info *find_function(const flat_node *name, func_table *const funcs)
 {
         assert(name);
-        assert(func_table);
+        assert(funcs);
 
-        const char *ident = ast_ident(name);
-        func_info *funcs = (func_info *)(func_table->data);
-        for (size_t i = 0; i < func_table->size; i++) {
-                if (funcs[i].ident == ident)
-                        return &funcs[i];
-        }
+        size_t index = 0;
+        if (!ident_map_find(&funcs->index, flat_ident(TREE, name), &index))
+                return nullptr;
 
-        return nullptr;
+        return (func_info *)funcs->funcs.data + index;
 }
 
-static const char *create_variable(ast_node *variable, symbol_table *table)
+static ir_operand create_variable(const flat_node *variable, symbol_table *table)
 {
         assert(table);
         assert(variable);
 
         var_info *var = nullptr;
 
-        const char *ident = find_variable(variable, table);
-        if (ident)
-                return nullptr;
+        ir_operand ident = find_variable(variable, table);
+        if (ident.kind)
+                return {};
 
-        if (variable->right && variable->right->type != AST_NODE_NUMBER)
-                return nullptr;
+        if (right(variable) && right(variable)->type != AST_NODE_NUMBER)
+                return {};
 
-        var = scope_table_add(table->local, variable);
+        var = add_variable(table->local, variable);
         if (var)
                 return find_variable(variable, table);
 
-        return nullptr;
+        return {};
 }
 
-static const char *get_variable(ast_node *variable, symbol_table *table)
+static ir_operand get_variable(const flat_node *variable, symbol_table *table)
 {
         assert(table);
         assert(variable);
@@ -807,149 +1253,178 @@ static const char *get_variable(ast_node *variable, symbol_table *table)
         var_info *var = nullptr;
 
 
-        var = scope_table_find(table->global, variable);
+        var = scope_table_find(table->global, flat_ident(TREE, variable));
         if (var) {
-                ast_node *error = compile_shift(variable, table);
+                const flat_node *error = compile_shift(variable, table);
                 if (error)
-                        return nullptr;
+                        return {};
 
-                if (var->node->left || variable->left) {
-                        dump_tree(var->node);
-                        return nullptr;
+                if (left(var->node) || left(variable)) {
+                        save_flat_tree(logs, TREE, var->node);
+                        return {};
                 }
 
                 return global_variable(var);
         }
 
-        var = scope_table_find(table->local, variable);
+        var = scope_table_find(table->local, flat_ident(TREE, variable));
         if (var) {
-                ast_node *error = compile_shift(variable, table);
+                const flat_node *error = compile_shift(variable, table);
                 if (error)
-                        return nullptr;
+                        return {};
 
-                if (var->node->left || variable->left) {
-                        dump_tree(var->node);
-                        return nullptr;
+                if (left(var->node) || left(variable)) {
+                        save_flat_tree(logs, TREE, var->node);
+                        return {};
                 }
 
                 return local_variable(var);
         }
 
-        if (variable->right && variable->right->type != AST_NODE_NUMBER)
-                return nullptr;
+        if (right(variable) && right(variable)->type != AST_NODE_NUMBER)
+                return {};
 
-        var = scope_table_add(table->local, variable);
+        var = add_variable(table->local, variable);
         if (var)
                 return find_variable(variable, table);
 
-        return nullptr;
+        return {};
 }
 
-static const char *find_variable(ast_node *variable, symbol_table *table, int memory)
+static ir_operand find_variable(const flat_node *variable, symbol_table *table, int memory)
 {
         assert(table);
         assert(variable);
 
         var_info *var = nullptr;
 
-        ast_node *error = compile_shift(variable, table);
+        const flat_node *error = compile_shift(variable, table);
         if (error)
-                return nullptr;
+                return {};
 
-        var = scope_table_find(table->global, variable);
+        var = scope_table_find(table->global, flat_ident(TREE, variable));
         if (var)
                 return global_variable(var, memory);
 
-        var = scope_table_find(table->local, variable);
+        var = scope_table_find(table->local, flat_ident(TREE, variable));
         if (var)
                 return local_variable(var, memory);
 
-        return nullptr;
+        return {};
 }
 
-static ast_node *compile_shift(ast_node *variable, symbol_table *table)
+static const flat_node *compile_shift(const flat_node *variable, symbol_table *table)
 {
         assert(variable);
 
-        if (!variable->right) {
-                PUSH("0");
-                POP(SHIFT_REG);
+        if (!right(variable)) {
+                PUSH(imm(0));
+                POP(reg(SHIFT_REG));
                 return success(variable);
         }
 
-        ast_node *error = compile_expr(variable->right, table);
+        const flat_node *error = compile_expr(right(variable), table);
         if (error)
                 return error;
 
-        POP(SHIFT_REG);
+        POP(reg(SHIFT_REG));
         return success(variable);
 }
 
 #define CMD(name, code, str, hash)                   \
-        static inline void name(const char *arg)     \
+        static inline void name(ir_operand arg)      \
         {                                            \
-                fprintf(file, "%*s", INDENT, "");  \
-                if (arg)                             \
-                        fprintf(file, "%s %s\n", str, arg); \
-                else                                 \
-                        fprintf(file, "%s\n", str);         \
+                ir_emit(CODE, IR_##name, INDENT, &arg); \
         }
 
 #include <commands>
 #undef CMD
 
-static inline void LABEL(const char *arg)
+static inline void LABEL(ir_operand arg)
 {
-        assert(arg);
-        fprintf(file, "%*s", INDENT, "");  \
-        fprintf(file, "%s:\n", arg);
+        assert(arg.kind == IR_ARG_LABEL);
+        ir_emit(CODE, IR_LABEL, INDENT, &arg);
 }
 
 static inline void WRITE(const char *arg)
 {
         assert(arg);
-        fprintf(file, "%s\n", arg);
+
+        ir_operand text = {};
+        text.kind = IR_ARG_TEXT;
+        text.name = arg;
+
+        ir_emit(CODE, IR_COMMENT, 0, &text);
+}
+
+static inline ir_operand id(const char *name, const flat_node *node)
+{
+        assert(name);
+        assert(node);
+        assert(FUNC);
+
+        ir_operand label = {};
+        label.kind   = IR_ARG_LABEL;
+        label.name   = name;
+        label.scope  = FUNC_NAME;
+        label.offset = node - FUNC;
+
+        return label;
 }
 
-static inline const char *id(const char *name, void *id)
+static inline ir_operand func_label(const char *name)
 {
         assert(name);
-        snprintf(BUFFER, BUFSIZE, "%s.%lx", name, id);
-        return BUFFER;
+
+        ir_operand label = {};
+        label.kind = IR_ARG_LABEL;
+        label.name = name;
+
+        return label;
 }
 
-static inline const char *number_str(double num)
+static inline ir_operand imm(double num)
 {
-        snprintf(BUFFER, BUFSIZE, "%lg", num);
-        return BUFFER;
+        ir_operand arg = {};
+        arg.kind = IR_ARG_IMM;
+        arg.imm  = num;
+
+        return arg;
 }
 
-static inline const char *memory(const char *reg, ptrdiff_t shift)
+static inline ir_operand reg(int reg)
 {
-        snprintf(BUFFER, BUFSIZE, "[%s + %ld]", reg, shift);
-        return BUFFER;
+        ir_operand arg = {};
+        arg.kind = IR_ARG_REG;
+        arg.base = reg;
+
+        return arg;
 }
 
-static inline const char *global_variable(var_info *var, int memory)
+static inline ir_operand global_variable(var_info *var, int memory)
 {
         assert(var);
-        if (memory)
-                snprintf(BUFFER, BUFSIZE, "[%s + %ld + %s]", GLOBAL_REG, var->shift, SHIFT_REG);
-        else
-                snprintf(BUFFER, BUFSIZE, "%s + %ld + %s", GLOBAL_REG, var->shift, SHIFT_REG);
 
-        return BUFFER;
+        ir_operand arg = {};
+        arg.kind   = memory ? IR_ARG_MEM : IR_ARG_ADDR;
+        arg.base   = GLOBAL_REG;
+        arg.index  = SHIFT_REG;
+        arg.offset = var->shift;
+
+        return arg;
 }
 
-static inline const char *local_variable(var_info *var, int memory)
+static inline ir_operand local_variable(var_info *var, int memory)
 {
         assert(var);
-        if (memory)
-                snprintf(BUFFER, BUFSIZE, "[%s + %ld + %s]", LOCAL_REG, var->shift, SHIFT_REG);
-        else
-                snprintf(BUFFER, BUFSIZE, "%s + %ld + %s", LOCAL_REG, var->shift, SHIFT_REG);
 
-        return BUFFER;
+        ir_operand arg = {};
+        arg.kind   = memory ? IR_ARG_MEM : IR_ARG_ADDR;
+        arg.base   = LOCAL_REG;
+        arg.index  = SHIFT_REG;
+        arg.offset = var->shift;
+
+        return arg;
 }
 
 static void dump_array_function(void *item)
@@ -960,15 +1435,50 @@ static void dump_array_function(void *item)
                 return;
 
         fprintf(logs, "%s(", func->ident);
-        ast_node *param = func->node->right;
+        const flat_node *param = right(func->node);
         if (param) {
-                while (param->left) {
-                        fprintf(logs, "%s, ", ast_ident(param->right));
-                        param = param->left;
+                while (left(param)) {
+                        fprintf(logs, "%s, ", flat_ident(TREE, right(param)));
+                        param = left(param);
                 }
 
-                fprintf(logs, "%s", ast_ident(param->right));
+                fprintf(logs, "%s", flat_ident(TREE, right(param)));
         }
 
         fprintf(logs, ")");
 }
+
+static uint64_t hash_context(symbol_table *table)
+{
+        assert(table);
+        uint64_t hash = 0;
+
+        var_info *vars = (var_info *)table->global->entries->data;
+        for (size_t i = 0; i < table->global->entries->size; i++) {
+                hash = hash_bytes(hash, vars[i].ident, strlen(vars[i].ident) + 1);
+                hash = hash_bytes(hash, &vars[i].shift, sizeof(vars[i].shift));
+        }
+
+        func_info *funcs = (func_info *)table->func->funcs.data;
+        for (size_t i = 0; i < table->func->funcs.size; i++) {
+                hash = hash_bytes(hash, funcs[i].ident, strlen(funcs[i].ident) + 1);
+                hash = hash_bytes(hash, &funcs[i].n_params, sizeof(funcs[i].n_params));
+        }
+
+        /* Optimized code is not the same code */
+        hash = hash_bytes(hash, &OPTIONS->optimize, sizeof(OPTIONS->optimize));
+        return hash;
+}
+
+static void optimize_code(array *const code)
+{
+        assert(code);
+        if (!OPTIONS->optimize)
+                return;
+
+        peephole_stats stats = {};
+        peephole(code, &stats);
+
+        if (OPTIONS->stats)
+                add_peephole_stats(OPTIONS->stats, &stats);
+}
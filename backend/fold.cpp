@@ -0,0 +1,466 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <assert.h>
+#include <logs.h>
+#include <array.h>
+#include <ast/tree.h>
+#include <ast/flat.h>
+#include <ast/walk.h>
+#include <ast/keyword.h>
+#include <backend/fold.h>
+
+/*
+ * What a node means depends on where it is.
+ */
+enum fold_context {
+        FOLD_STMT   = 0x00, /* statements and declarations        */
+        FOLD_EXPR   = 0x01, /* value of an expression             */
+        FOLD_ARGS   = 0x02, /* parameter list of a call           */
+        FOLD_TARGET = 0x03, /* assigned variable, index is a value */
+};
+
+/*
+ * Global declared by the global assignment 'decl'. As in
+ * the backend, only the first declaration of a name counts.
+ * The value is known if it is an inv set to a constant.
+ * Functions see it only if it is set before any global
+ * initializer calls a function.
+ */
+struct fold_const {
+        const char *ident = nullptr;
+        double      value = 0;
+        bool        known = false;
+
+        uint32_t decl     = 0;
+        bool in_functions = false;
+};
+
+/*
+ * Nodes on the walk path. The pools had 'n_constants' and
+ * 'n_names' items before the subtree, a folded subtree
+ * gives the rest back.
+ */
+struct fold_frame {
+        const flat_node *node = nullptr;
+        int context = FOLD_STMT;
+
+        uint32_t index = 0;
+        uint32_t left  = 0;
+        uint32_t right = 0;
+
+        size_t n_constants = 0;
+        size_t n_names     = 0;
+
+        bool   left_known  = false;
+        bool   right_known = false;
+        double left_value  = 0;
+        double right_value = 0;
+};
+
+struct folder {
+        const flat_tree *tree = nullptr;
+        flat_tree *folded     = nullptr;
+
+        array path   = {};
+        array consts = {};
+
+        bool globals = false;  /* functions are skipped               */
+        bool calls   = false;  /* a global initializer calls functions */
+
+        const flat_node *define = nullptr;
+};
+
+static const size_t NUMSIZE = 32;
+
+static int fold_tree(folder *const fl);
+static int fold_node(const flat_node *node, void *ctx);
+static int fold_done(const flat_node *node, void *ctx);
+
+static int  child_context(const folder *const fl, const fold_frame *parent,
+                          const flat_node *node);
+static bool fold_value(const folder *const fl, const fold_frame *frame, double *value);
+static int  add_const (folder *const fl, const fold_frame *frame);
+
+static const fold_const *find_const(const folder *const fl, const flat_node *node);
+
+static double machine_number(double value);
+static bool   exact_number(double value);
+
+static ast_node node_value(const flat_tree *const tree, const flat_node *node);
+static int keyword(const flat_node *node);
+
+int fold_constants(const flat_tree *const tree, flat_tree *const folded)
+{
+        assert(tree);
+        assert(folded);
+        assert(!folded->nodes.size);
+
+        if (!flat_root(tree))
+                return 1;
+
+        folder fl = {};
+        fl.tree = tree;
+
+        /* Functions may use globals set after them, globals go first */
+        flat_tree globals = {};
+        fl.folded  = &globals;
+        fl.globals = true;
+
+        int error = fold_tree(&fl);
+        free_flat_tree(&globals);
+
+        if (!error) {
+                fl.folded  = folded;
+                fl.globals = false;
+                error = fold_tree(&fl);
+        }
+
+        free_array(&fl.path,   sizeof(fold_frame));
+        free_array(&fl.consts, sizeof(fold_const));
+
+        if (error) {
+                fprintf(logs, "Can't fold the tree\n");
+                return 1;
+        }
+
+        return 0;
+}
+
+static int fold_tree(folder *const fl)
+{
+        assert(fl);
+
+        fl->define = nullptr;
+
+        flat_visitor visitor = {};
+        visitor.pre  = fold_node;
+        visitor.post = fold_done;
+        visitor.ctx  = fl;
+
+        return walk_flat_tree(fl->tree, flat_root(fl->tree), &visitor);
+}
+
+static int fold_node(const flat_node *node, void *ctx)
+{
+        folder *fl = (folder *)ctx;
+
+        fold_frame frame = {};
+        frame.node    = node;
+        frame.context = FOLD_STMT;
+
+        if (keyword(node) == AST_DEFINE) {
+                if (fl->globals)
+                        return WALK_SKIP;
+
+                fl->define = node;
+        }
+
+        if (!fl->define && keyword(node) == AST_CALL)
+                fl->calls = true;
+
+        frame.n_constants = fl->folded->constants.size;
+        frame.n_names     = fl->folded->names.size;
+
+        if (reserve_flat_node(fl->folded, &frame.index))
+                return WALK_STOP;
+
+        if (fl->path.size) {
+                fold_frame *parent = (fold_frame *)array_top(&fl->path, sizeof(fold_frame));
+                frame.context = child_context(fl, parent, node);
+
+                if (flat_left(fl->tree, parent->node) == node)
+                        parent->left  = frame.index;
+                else
+                        parent->right = frame.index;
+        }
+
+        if (!array_push(&fl->path, &frame, sizeof(fold_frame)))
+                return WALK_STOP;
+
+        return WALK_NEXT;
+}
+
+static int fold_done(const flat_node *node, void *ctx)
+{
+        folder *fl = (folder *)ctx;
+        fold_frame *frame = (fold_frame *)array_top(&fl->path, sizeof(fold_frame));
+
+        double value = 0;
+        bool known = fold_value(fl, frame, &value);
+
+        ast_node copy = node_value(fl->tree, node);
+        uint32_t left  = frame->left;
+        uint32_t right = frame->right;
+
+        /* Numbers are as short as they get */
+        if (known && node->type != AST_NODE_NUMBER && exact_number(value)) {
+                fl->folded->nodes.size     = frame->index + 1;
+                fl->folded->constants.size = frame->n_constants;
+                fl->folded->names.size     = frame->n_names;
+
+                copy.type = AST_NODE_NUMBER;
+                copy.data.number = value;
+                left  = 0;
+                right = 0;
+        }
+
+        if (set_flat_node(fl->folded, frame->index, &copy, left, right))
+                return WALK_STOP;
+
+        if (fl->globals && !fl->define && keyword(node) == AST_ASSIGN &&
+            add_const(fl, frame))
+                return WALK_STOP;
+
+        if (node == fl->define)
+                fl->define = nullptr;
+
+        array_pop(&fl->path, sizeof(fold_frame));
+        if (!fl->path.size)
+                return WALK_NEXT;
+
+        fold_frame *parent = (fold_frame *)array_top(&fl->path, sizeof(fold_frame));
+        if (flat_left(fl->tree, parent->node) == node) {
+                parent->left_known  = known;
+                parent->left_value  = value;
+        } else {
+                parent->right_known = known;
+                parent->right_value = value;
+        }
+
+        return WALK_NEXT;
+}
+
+static int child_context(const folder *const fl, const fold_frame *parent,
+                         const flat_node *node)
+{
+        assert(fl);
+        assert(parent);
+        assert(node);
+
+        bool left = flat_left(fl->tree, parent->node) == node;
+
+        switch (parent->context) {
+        case FOLD_EXPR:
+                if (parent->node->type == AST_NODE_IDENT)
+                        return left ? FOLD_STMT : FOLD_EXPR;
+                if (keyword(parent->node) == AST_CALL)
+                        return left ? FOLD_STMT : FOLD_ARGS;
+                return FOLD_EXPR;
+        case FOLD_ARGS:
+                return left ? FOLD_ARGS : FOLD_EXPR;
+        case FOLD_TARGET:
+                return left ? FOLD_STMT : FOLD_EXPR;
+        case FOLD_STMT:
+        default:
+                break;
+        }
+
+        switch (keyword(parent->node)) {
+        case AST_ASSIGN:
+        case AST_SHOW:
+                return left ? FOLD_TARGET : FOLD_EXPR;
+        case AST_IF:
+        case AST_WHILE:
+                return left ? FOLD_EXPR : FOLD_STMT;
+        case AST_RETURN:
+        case AST_OUT:
+                return left ? FOLD_STMT : FOLD_EXPR;
+        case AST_CALL:
+                return left ? FOLD_STMT : FOLD_ARGS;
+        default:
+                return FOLD_STMT;
+        }
+}
+
+/*
+ * Comparisons and logic are left to the machine,
+ * only arithmetic is computed.
+ */
+static bool fold_value(const folder *const fl, const fold_frame *frame, double *value)
+{
+        assert(fl);
+        assert(frame);
+        assert(value);
+
+        const flat_node *node = frame->node;
+        const fold_const *constant = nullptr;
+
+        double a = frame->left_value;
+        double b = frame->right_value;
+        bool binary = node->left  && frame->left_known &&
+                      node->right && frame->right_known;
+        bool unary  = !node->left && node->right && frame->right_known;
+
+        switch (node->type) {
+        case AST_NODE_NUMBER:
+                *value = machine_number(*flat_number(fl->tree, node));
+                return true;
+        case AST_NODE_IDENT:
+                if (frame->context != FOLD_EXPR || node->left || node->right)
+                        return false;
+
+                constant = find_const(fl, node);
+                if (!constant)
+                        return false;
+
+                *value = constant->value;
+                return true;
+        default:
+                break;
+        }
+
+        if (frame->context != FOLD_EXPR)
+                return false;
+
+        switch (keyword(node)) {
+        case AST_ADD:
+                *value = a + b;
+                break;
+        case AST_SUB:
+                *value = a - b;
+                break;
+        case AST_MUL:
+                *value = a * b;
+                break;
+        case AST_DIV:
+                if (fpclassify(b) == FP_ZERO)
+                        return false;
+                *value = a / b;
+                break;
+        case AST_POW:
+                *value = pow(a, b);
+                break;
+        case AST_SIN:
+                *value = sin(b);
+                return unary && isfinite(*value);
+        case AST_COS:
+                *value = cos(b);
+                return unary && isfinite(*value);
+        case AST_INT:
+                /* Rounding is up to the machine, integers stay */
+                *value = b;
+                return unary && isfinite(b) && fpclassify(b - trunc(b)) == FP_ZERO;
+        default:
+                return false;
+        }
+
+        return binary && isfinite(*value);
+}
+
+static int add_const(folder *const fl, const fold_frame *frame)
+{
+        assert(fl);
+        assert(frame);
+
+        const flat_node *target = flat_left(fl->tree, frame->node);
+        if (!target || target->type != AST_NODE_IDENT)
+                return 0;
+
+        /* Later declarations don't change the variable */
+        const char *ident = flat_ident(fl->tree, target);
+        const fold_const *consts = (const fold_const *)fl->consts.data;
+        for (size_t i = 0; i < fl->consts.size; i++) {
+                if (consts[i].ident == ident)
+                        return 0;
+        }
+
+        const flat_node *flag = flat_left(fl->tree, target);
+
+        fold_const constant = {};
+        constant.ident = ident;
+        constant.value = frame->right_value;
+        constant.known = flag && keyword(flag) == AST_CONST &&
+                         !target->right && frame->right_known;
+        constant.decl  = (uint32_t)(frame->node - flat_root(fl->tree));
+        constant.in_functions = !fl->calls;
+
+        if (!array_push(&fl->consts, &constant, sizeof(fold_const)))
+                return 1;
+
+        return 0;
+}
+
+static const fold_const *find_const(const folder *const fl, const flat_node *node)
+{
+        assert(fl);
+        assert(node);
+
+        const char *ident = flat_ident(fl->tree, node);
+        uint32_t index = (uint32_t)(node - flat_root(fl->tree));
+
+        const fold_const *consts = (const fold_const *)fl->consts.data;
+        for (size_t i = 0; i < fl->consts.size; i++) {
+                if (consts[i].ident != ident)
+                        continue;
+
+                if (!consts[i].known)
+                        return nullptr;
+
+                if (fl->define ? consts[i].in_functions : index > consts[i].decl)
+                        return &consts[i];
+
+                return nullptr;
+        }
+
+        return nullptr;
+}
+
+/*
+ * The machine gets numbers as print_ir() prints them.
+ */
+static double machine_number(double value)
+{
+        char num[NUMSIZE] = {0};
+        snprintf(num, NUMSIZE, "%lg", value);
+
+        return strtod(num, nullptr);
+}
+
+/*
+ * Sources have no negative numbers, the code doesn't get them either.
+ */
+static bool exact_number(double value)
+{
+        double printed = machine_number(value);
+
+        return isfinite(value) && !signbit(value) &&
+               !memcmp(&printed, &value, sizeof(double));
+}
+
+static ast_node node_value(const flat_tree *const tree, const flat_node *node)
+{
+        assert(tree);
+        assert(node);
+
+        ast_node value = {};
+        value.type = (int)node->type;
+
+        switch (node->type) {
+        case AST_NODE_KEYWORD:
+                value.data.keyword = flat_keyword(node);
+                break;
+        case AST_NODE_NUMBER:
+                value.data.number = *flat_number(tree, node);
+                break;
+        case AST_NODE_IDENT:
+                value.data.ident = flat_ident(tree, node);
+                break;
+        default:
+                assert(0 && "Invalid node");
+                break;
+        }
+
+        return value;
+}
+
+static int keyword(const flat_node *node)
+{
+        assert(node);
+
+        if (node->type == AST_NODE_KEYWORD)
+                return flat_keyword(node);
+
+        return 0;
+}
@@ -0,0 +1,130 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <assert.h>
+#include <logs.h>
+#include <backend/ident_map.h>
+
+static const size_t INIT_CAPACITY = 64;
+
+static inline size_t hash_ident(const char *ident)
+{
+        /* Fibonacci hashing, low bits of a pointer are zeros */
+        uint64_t hash = (uintptr_t)ident * 0x9E3779B97F4A7C15ull;
+        return hash >> 32;
+}
+
+static ident_slot *find_slot(ident_slot *slots, size_t capacity, const char *ident)
+{
+        assert(slots);
+        assert(ident);
+
+        size_t mask = capacity - 1;
+        for (size_t i = hash_ident(ident) & mask; ; i = (i + 1) & mask) {
+                ident_slot *slot = &slots[i];
+                if (!slot->ident || slot->ident == ident)
+                        return slot;
+        }
+}
+
+static int expand_slots(ident_map *const map)
+{
+        assert(map);
+
+        size_t capacity = map->capacity ? map->capacity * 2 : INIT_CAPACITY;
+
+        ident_slot *slots = (ident_slot *)calloc(capacity, sizeof(ident_slot));
+        if (!slots) {
+                fprintf(logs, "Can't expand identifier map\n");
+                return 1;
+        }
+
+        for (size_t i = 0; i < map->capacity; i++) {
+                ident_slot *old = &map->slots[i];
+                if (old->ident)
+                        *find_slot(slots, capacity, old->ident) = *old;
+        }
+
+        free(map->slots);
+        map->slots    = slots;
+        map->capacity = capacity;
+
+        return 0;
+}
+
+int ident_map_add(ident_map *const map, const char *ident, size_t index)
+{
+        assert(map);
+        assert(ident);
+
+        /* Keep load factor below 1/2 */
+        if (map->size * 2 >= map->capacity) {
+                if (expand_slots(map))
+                        return 1;
+        }
+
+        ident_slot *slot = find_slot(map->slots, map->capacity, ident);
+        if (slot->ident)
+                return 0;
+
+        slot->ident = ident;
+        slot->index = index;
+        map->size++;
+
+        return 0;
+}
+
+bool ident_map_find(const ident_map *const map, const char *ident, size_t *index)
+{
+        assert(map);
+        assert(ident);
+        assert(index);
+
+        if (!map->size)
+                return false;
+
+        ident_slot *slot = find_slot(map->slots, map->capacity, ident);
+        if (!slot->ident)
+                return false;
+
+        *index = slot->index;
+        return true;
+}
+
+void ident_map_remove(ident_map *const map, const char *ident, size_t index)
+{
+        assert(map);
+        assert(ident);
+
+        if (!map->size)
+                return;
+
+        ident_slot *slot = find_slot(map->slots, map->capacity, ident);
+        if (!slot->ident || slot->index != index)
+                return;
+
+        /* Slots after the hole move back, so probing never stops early */
+        size_t mask = map->capacity - 1;
+        size_t hole = (size_t)(slot - map->slots);
+
+        for (size_t i = (hole + 1) & mask; map->slots[i].ident; i = (i + 1) & mask) {
+                size_t home = hash_ident(map->slots[i].ident) & mask;
+                if (((i - home) & mask) >= ((i - hole) & mask)) {
+                        map->slots[hole] = map->slots[i];
+                        hole = i;
+                }
+        }
+
+        map->slots[hole] = {};
+        map->size--;
+}
+
+void free_ident_map(ident_map *const map)
+{
+        assert(map);
+
+        free(map->slots);
+        map->slots    = nullptr;
+        map->capacity = 0;
+        map->size     = 0;
+}
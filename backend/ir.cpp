@@ -0,0 +1,227 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <logs.h>
+#include <array.h>
+#include <backend/ir.h>
+
+/*
+ * Text goes to 'buf' and 'file' gets it in large writes.
+ */
+struct ir_printer {
+        FILE *file = nullptr;
+
+        char  *buf = nullptr;
+        size_t size     = 0;
+        size_t capacity = 0;
+
+        bool failed = false;
+};
+
+static const size_t PRINT_BUFSIZE = 64 * 1024;
+static const size_t NUMSIZE = 32;
+
+static void flush(ir_printer *const printer);
+static void put(ir_printer *const printer, const char *str, size_t length);
+static void put_str(ir_printer *const printer, const char *str);
+static void put_char(ir_printer *const printer, char c);
+static void put_spaces(ir_printer *const printer, int n_spaces);
+static void put_operand(ir_printer *const printer, const ir_operand *arg);
+
+static const char *opcode_string(int opcode);
+static const char *register_string(int reg);
+
+ir_instr *ir_emit(array *const code, int opcode, int indent, const ir_operand *arg)
+{
+        assert(code);
+
+        ir_instr instr = {};
+        instr.opcode = opcode;
+        instr.indent = indent;
+        if (arg)
+                instr.arg = *arg;
+
+        return (ir_instr *)array_push(code, &instr, sizeof(ir_instr));
+}
+
+int print_ir(FILE *file, const array *const code)
+{
+        assert(file);
+        assert(code);
+
+        ir_printer printer = {};
+        printer.file     = file;
+        printer.capacity = PRINT_BUFSIZE;
+        printer.buf      = (char *)calloc(PRINT_BUFSIZE, sizeof(char));
+        if (!printer.buf)
+                return EXIT_FAILURE;
+
+        const ir_instr *instrs = (const ir_instr *)code->data;
+        for (size_t i = 0; i < code->size; i++) {
+                const ir_instr *instr = &instrs[i];
+
+                switch (instr->opcode) {
+                case IR_COMMENT:
+                        put_operand(&printer, &instr->arg);
+                        break;
+                case IR_LABEL:
+                        put_spaces(&printer, instr->indent);
+                        put_operand(&printer, &instr->arg);
+                        put_char(&printer, ':');
+                        break;
+                default:
+                        put_spaces(&printer, instr->indent);
+                        put_str(&printer, opcode_string(instr->opcode));
+                        if (instr->arg.kind) {
+                                put_char(&printer, ' ');
+                                put_operand(&printer, &instr->arg);
+                        }
+                        break;
+                }
+
+                put_char(&printer, '\n');
+        }
+
+        flush(&printer);
+        free(printer.buf);
+
+        return printer.failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+static void put_operand(ir_printer *const printer, const ir_operand *arg)
+{
+        assert(printer);
+        assert(arg);
+
+        char num[NUMSIZE] = {0};
+        int length = 0;
+
+        switch (arg->kind) {
+        case IR_ARG_IMM:
+                length = snprintf(num, NUMSIZE, "%lg", arg->imm);
+                put(printer, num, (size_t)length);
+                break;
+        case IR_ARG_REG:
+                put_str(printer, register_string(arg->base));
+                break;
+        case IR_ARG_MEM:
+        case IR_ARG_ADDR:
+                if (arg->kind == IR_ARG_MEM)
+                        put_char(printer, '[');
+
+                length = snprintf(num, NUMSIZE, " + %td + ", arg->offset);
+                put_str(printer, register_string(arg->base));
+                put(printer, num, (size_t)length);
+                put_str(printer, register_string(arg->index));
+
+                if (arg->kind == IR_ARG_MEM)
+                        put_char(printer, ']');
+                break;
+        case IR_ARG_LABEL:
+                put_str(printer, arg->name);
+                if (arg->scope) {
+                        put_char(printer, '.');
+                        put_str(printer, arg->scope);
+                        length = snprintf(num, NUMSIZE, ".%td", arg->offset);
+                        put(printer, num, (size_t)length);
+                }
+                break;
+        case IR_ARG_TEXT:
+                put_str(printer, arg->name);
+                break;
+        case IR_ARG_NONE:
+        default:
+                assert(0 && "Invalid operand");
+                break;
+        }
+}
+
+static void put(ir_printer *const printer, const char *str, size_t length)
+{
+        assert(printer);
+        assert(str);
+
+        if (printer->size + length > printer->capacity) {
+                flush(printer);
+
+                /* Longer than the buffer, don't copy it */
+                if (length > printer->capacity) {
+                        if (fwrite(str, sizeof(char), length, printer->file) != length)
+                                printer->failed = true;
+                        return;
+                }
+        }
+
+        memcpy(printer->buf + printer->size, str, length);
+        printer->size += length;
+}
+
+static void put_str(ir_printer *const printer, const char *str)
+{
+        assert(str);
+        put(printer, str, strlen(str));
+}
+
+static void put_char(ir_printer *const printer, char c)
+{
+        put(printer, &c, 1);
+}
+
+static void put_spaces(ir_printer *const printer, int n_spaces)
+{
+        static const char SPACES[] = "                                ";
+
+        while (n_spaces > 0) {
+                size_t length = (size_t)n_spaces < sizeof(SPACES) - 1 ?
+                                (size_t)n_spaces : sizeof(SPACES) - 1;
+
+                put(printer, SPACES, length);
+                n_spaces -= (int)length;
+        }
+}
+
+static void flush(ir_printer *const printer)
+{
+        assert(printer);
+
+        if (!printer->size)
+                return;
+
+        if (fwrite(printer->buf, sizeof(char), printer->size, printer->file) != printer->size)
+                printer->failed = true;
+
+        printer->size = 0;
+}
+
+static const char *opcode_string(int opcode)
+{
+        switch (opcode) {
+#define CMD(name, code, str, hash) \
+        case IR_##name:            \
+                return str;
+#include <commands>
+#undef CMD
+        default:
+                assert(0 && "Invalid opcode");
+                return "???";
+        }
+}
+
+static const char *register_string(int reg)
+{
+        switch (reg) {
+        case IR_AX:
+                return "ax";
+        case IR_BX:
+                return "bx";
+        case IR_CX:
+                return "cx";
+        case IR_HX:
+                return "hx";
+        case IR_NO_REG:
+        default:
+                assert(0 && "Invalid register");
+                return "??";
+        }
+}
@@ -2,30 +2,84 @@
 #include <stdlib.h>
 #include <logs.h>
 #include <array.h>
+#include <interner.h>
 #include <iommap.h>
 #include <assert.h>
 #include <string.h>
 #include <time.h>
 #include <errno.h>
+#include <unistd.h>
 #include <stack.h>
+#include <parallel.h>
 #include <ast/tree.h>
+#include <ast/flat.h>
+#include <ast/binary.h>
 #include <ast/keyword.h>
 #include <backend/scope_table.h>
+#include <backend/code_cache.h>
+#include <backend/peephole.h>
 #include <backend/backend.h>
 
 static int input_error();
 static int file_error(const char *file_name);
 
 
+/*
+ * Usage: cum [-j threads] [-C cache] [-O level] [-v] tree asm
+ *
+ *      -j  compile functions on 'threads' threads,
+ *          all processors by default
+ *      -C  reuse the code of unchanged functions
+ *          from the 'cache' directory and store
+ *          the compiled ones there
+ *      -O  0 turns the optimizations off, 1 by default
+ *      -v  report what the optimizations did
+ */
 int main(int argc, char *argv[])
 {
-        if (argc != 3) {
-                fprintf(stderr, ascii(red, "There must be 2 arguments\n"));
-                return EXIT_FAILURE;
+        const char *cache_dir = nullptr;
+        bool verbose = false;
+
+        backend_options options = {};
+        options.n_threads = online_cpus();
+
+        int opt = 0;
+        while ((opt = getopt(argc, argv, "j:C:O:v")) != -1) {
+                switch (opt) {
+                case 'j':
+                        options.n_threads = strtoul(optarg, nullptr, 10);
+                        if (!options.n_threads)
+                                return input_error();
+                        break;
+                case 'C':
+                        cache_dir = optarg;
+                        break;
+                case 'O':
+                        options.optimize = strtoul(optarg, nullptr, 10) != 0;
+                        break;
+                case 'v':
+                        verbose = true;
+                        break;
+                default:
+                        return input_error();
+                }
         }
 
-        const char *src_file = argv[1];
-        const char *out_file = argv[2];
+        if (argc - optind != 2)
+                return input_error();
+
+        const char *src_file = argv[optind];
+        const char *out_file = argv[optind + 1];
+
+        code_cache cache = {};
+        if (cache_dir && open_code_cache(&cache, cache_dir))
+                return EXIT_FAILURE;
+
+        peephole_stats stats = {};
+        if (cache_dir)
+                options.cache = &cache;
+        if (verbose)
+                options.stats = &stats;
 
         clock_t start = clock();
         FILE *out = fopen(out_file, "w");
@@ -37,43 +91,46 @@ int main(int argc, char *argv[])
         if (error)
                 return EXIT_FAILURE;
 
-        array idents = {0};
+        interner  idents = {};
+        flat_tree tree   = {};
 
-        ast_node *err = nullptr;
-        char *reader = md.buf;
-        ast_node *tree = read_ast_tree(&reader, &idents);
-        mmap_free(&md);
-        if (!tree)
+        /* Binary tree is used in place, keep the mapping until the end */
+        error = load_flat_tree(md.buf, md.size, &idents, &tree);
+        if (error)
                 goto fail;
 
-        $(dump_tree(tree);)
-        error = compile_tree(out, tree);
+        $(save_flat_tree(logs, &tree, flat_root(&tree));)
+        error = compile_tree(out, &tree, &options);
         if (error)
                 goto fail;
 
-fail:
-        char **data = (char **)idents.data;
-        for (size_t i = 0; i < idents.size; i++) {
-                free(data[i]);
-        }
+        if (verbose && options.optimize)
+                dump_peephole_stats(stderr, &stats);
 
-        free_array(&idents, sizeof(char *));
+        if (cache_dir)
+                fprintf(stderr, "Cached functions: %zu of %zu\n",
+                                cache.n_hits, cache.n_hits + cache.n_misses);
+
+fail:
+        free_flat_tree(&tree);
+        free_interner(&idents);
+        mmap_free(&md);
         fclose(out);
 
         clock_t end = clock();
 
-        if (!tree || error) {
+        if (error) {
                 fprintf(stderr, ascii(red, "Compilation failed\n"));
                 return EXIT_FAILURE;
         }
 
-        fprintf(stderr, ascii(green, "Compilation succeed: %lf sec\n"), (end - start) / CLOCKS_PER_SEC);
+        fprintf(stderr, ascii(green, "Compilation succeed: %lf sec\n"), (double)(end - start) / CLOCKS_PER_SEC);
         return EXIT_SUCCESS;
 }
 
 static int input_error()
 {
-        fprintf(stderr, ascii(red, "There must be 3 arguments\n"));
+        fprintf(stderr, ascii(red, "Usage: cum [-j threads] [-C cache] [-O level] [-v] tree asm\n"));
         return EXIT_FAILURE;
 }
 
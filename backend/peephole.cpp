@@ -0,0 +1,509 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <assert.h>
+#include <logs.h>
+#include <array.h>
+#include <backend/ir.h>
+#include <backend/peephole.h>
+
+/*
+ * Deleted instructions are marked and squeezed out
+ * after every sweep. No opcode has this value.
+ */
+static const int DELETED = 0;
+
+static const size_t MAX_WINDOW = 8;
+
+/*
+ * Pattern looks at 'length' instructions in a row. Labels are
+ * instructions too, so nothing matches across a jump target.
+ * Comments are skipped. Returns true if the code is rewritten.
+ */
+struct peephole_pattern {
+        int pass      = 0;
+        size_t length = 0;
+
+        bool (*apply)(ir_instr **w);
+};
+
+static bool push_pop_same   (ir_instr **w);
+static bool push_drop       (ir_instr **w);
+static bool push_frame_drop (ir_instr **w);
+static bool frame_zero      (ir_instr **w);
+static bool frame_merge     (ir_instr **w);
+static bool compare_jump    (ir_instr **w);
+static bool jump_next       (ir_instr **w);
+
+static const peephole_pattern PATTERNS[] = {
+        { PEEP_PUSH_POP,     2, push_pop_same   },
+        { PEEP_PUSH_POP,     2, push_drop       },
+        { PEEP_PUSH_POP,     6, push_frame_drop },
+        { PEEP_FRAME,        4, frame_zero      },
+        { PEEP_FRAME,        8, frame_merge     },
+        { PEEP_COMPARE_JUMP, 3, compare_jump    },
+        { PEEP_JUMP_NEXT,    2, jump_next       },
+};
+
+static const size_t N_PATTERNS = sizeof(PATTERNS) / sizeof(PATTERNS[0]);
+
+static const char *const PASS_NAMES[N_PEEPHOLE_PASSES] = {
+        "push/pop pairs",
+        "frame adjustments",
+        "known registers",
+        "compare and jump",
+        "jumps to next",
+        "dead code",
+};
+
+static bool apply_patterns(ir_instr *code, size_t size, peephole_stats *const stats);
+static bool known_registers(ir_instr *code, size_t size, peephole_stats *const stats);
+static bool dead_code(ir_instr *code, size_t size, peephole_stats *const stats);
+
+static size_t compact(array *const code);
+static size_t count_instrs(const array *const code);
+static size_t gather(ir_instr *code, size_t size, size_t i, ir_instr **w, size_t n);
+
+static bool same_operand(const ir_operand *a, const ir_operand *b);
+static bool frame_adjust(ir_instr **w, int *reg, double *delta);
+static void set_frame_adjust(ir_instr **w, double delta);
+static bool reads_register(const ir_operand *arg, int reg);
+static void erase(ir_instr **w, size_t n);
+
+void peephole(array *const code, peephole_stats *const stats)
+{
+        assert(code);
+
+        peephole_stats local = {};
+        local.n_before = count_instrs(code);
+
+        bool changed = true;
+        while (changed) {
+                ir_instr *instrs = ir_code(code);
+                size_t size = code->size;
+
+                changed  = apply_patterns (instrs, size, &local);
+                changed |= known_registers(instrs, size, &local);
+                changed |= dead_code      (instrs, size, &local);
+
+                compact(code);
+        }
+
+        local.n_after = count_instrs(code);
+
+        if (stats)
+                *stats = local;
+}
+
+void add_peephole_stats(peephole_stats *const to, const peephole_stats *from)
+{
+        assert(to);
+        assert(from);
+
+        __atomic_fetch_add(&to->n_before, from->n_before, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&to->n_after,  from->n_after,  __ATOMIC_RELAXED);
+
+        for (size_t i = 0; i < N_PEEPHOLE_PASSES; i++)
+                __atomic_fetch_add(&to->applied[i], from->applied[i], __ATOMIC_RELAXED);
+}
+
+void dump_peephole_stats(FILE *file, const peephole_stats *stats)
+{
+        assert(file);
+        assert(stats);
+
+        fprintf(file, "Peephole: %zu --> %zu instructions\n",
+                      stats->n_before, stats->n_after);
+
+        for (size_t i = 0; i < N_PEEPHOLE_PASSES; i++)
+                fprintf(file, "    %-20s %zu\n", PASS_NAMES[i], stats->applied[i]);
+}
+
+static bool apply_patterns(ir_instr *code, size_t size, peephole_stats *const stats)
+{
+        assert(code);
+        assert(stats);
+
+        bool changed = false;
+        ir_instr *w[MAX_WINDOW] = {0};
+
+        for (size_t i = 0; i < size; i++) {
+                if (code[i].opcode == DELETED || code[i].opcode == IR_COMMENT)
+                        continue;
+
+                size_t n = gather(code, size, i, w, MAX_WINDOW);
+                for (size_t p = 0; p < N_PATTERNS; p++) {
+                        if (PATTERNS[p].length > n || !PATTERNS[p].apply(w))
+                                continue;
+
+                        stats->applied[PATTERNS[p].pass]++;
+                        changed = true;
+
+                        /* Window is stale now */
+                        if (code[i].opcode == DELETED)
+                                break;
+
+                        n = gather(code, size, i, w, MAX_WINDOW);
+                }
+        }
+
+        return changed;
+}
+
+/*
+ * Drops 'push k / pop r' if 'r' already holds 'k'. Values are only
+ * known inside a straight run of code: jumps land on labels
+ * and calls change anything.
+ */
+static bool known_registers(ir_instr *code, size_t size, peephole_stats *const stats)
+{
+        assert(code);
+        assert(stats);
+
+        static const int N_REGS = IR_HX + 1;
+
+        bool   known[N_REGS] = {0};
+        double value[N_REGS] = {0};
+
+        bool changed = false;
+        ir_instr *w[2] = {0};
+
+        for (size_t i = 0; i < size; i++) {
+                int opcode = code[i].opcode;
+                if (opcode == DELETED || opcode == IR_COMMENT)
+                        continue;
+
+                if (opcode == IR_LABEL || opcode == IR_CALL) {
+                        memset(known, 0, sizeof(known));
+                        continue;
+                }
+
+                if (opcode == IR_POP && code[i].arg.kind == IR_ARG_REG) {
+                        known[code[i].arg.base] = false;
+                        continue;
+                }
+
+                if (opcode != IR_PUSH || code[i].arg.kind != IR_ARG_IMM ||
+                    gather(code, size, i, w, 2) != 2)
+                        continue;
+
+                if (w[1]->opcode != IR_POP || w[1]->arg.kind != IR_ARG_REG)
+                        continue;
+
+                int reg = w[1]->arg.base;
+                double imm = w[0]->arg.imm;
+
+                if (known[reg] && !memcmp(&value[reg], &imm, sizeof(double))) {
+                        erase(w, 2);
+                        stats->applied[PEEP_KNOWN_REG]++;
+                        changed = true;
+                } else {
+                        known[reg] = true;
+                        value[reg] = imm;
+                }
+
+                /* Skip the pop, it is handled */
+                i = (size_t)(w[1] - code);
+        }
+
+        return changed;
+}
+
+static bool dead_code(ir_instr *code, size_t size, peephole_stats *const stats)
+{
+        assert(code);
+        assert(stats);
+
+        bool changed = false;
+        bool dead    = false;
+
+        for (size_t i = 0; i < size; i++) {
+                switch (code[i].opcode) {
+                case DELETED:
+                case IR_COMMENT:
+                        break;
+                case IR_LABEL:
+                        dead = false;
+                        break;
+                default:
+                        if (dead) {
+                                code[i].opcode = DELETED;
+                                stats->applied[PEEP_DEAD_CODE]++;
+                                changed = true;
+                                break;
+                        }
+
+                        dead = code[i].opcode == IR_JMP ||
+                               code[i].opcode == IR_RET ||
+                               code[i].opcode == IR_HLT;
+                        break;
+                }
+        }
+
+        return changed;
+}
+
+/*
+ * push x / pop x
+ */
+static bool push_pop_same(ir_instr **w)
+{
+        if (w[0]->opcode != IR_PUSH || w[1]->opcode != IR_POP)
+                return false;
+
+        if (w[0]->arg.kind != IR_ARG_REG && w[0]->arg.kind != IR_ARG_MEM)
+                return false;
+
+        if (!same_operand(&w[0]->arg, &w[1]->arg))
+                return false;
+
+        erase(w, 2);
+        return true;
+}
+
+/*
+ * push x / pop  -- value is dropped right away
+ */
+static bool push_drop(ir_instr **w)
+{
+        if (w[0]->opcode != IR_PUSH || w[1]->opcode != IR_POP || w[1]->arg.kind)
+                return false;
+
+        erase(w, 2);
+        return true;
+}
+
+/*
+ * push x / <frame adjustment> / pop, result of a call statement
+ */
+static bool push_frame_drop(ir_instr **w)
+{
+        int reg = 0;
+        double delta = 0;
+
+        if (w[0]->opcode != IR_PUSH || w[5]->opcode != IR_POP || w[5]->arg.kind)
+                return false;
+
+        if (!frame_adjust(w + 1, &reg, &delta) || reads_register(&w[0]->arg, reg))
+                return false;
+
+        w[0]->opcode = DELETED;
+        w[5]->opcode = DELETED;
+        return true;
+}
+
+/*
+ * push r / push 0 / add / pop r
+ */
+static bool frame_zero(ir_instr **w)
+{
+        int reg = 0;
+        double delta = 0;
+
+        if (!frame_adjust(w, &reg, &delta) || fpclassify(delta) != FP_ZERO)
+                return false;
+
+        erase(w, 4);
+        return true;
+}
+
+/*
+ * push r / push a / add / pop r / push r / push b / sub / pop r
+ */
+static bool frame_merge(ir_instr **w)
+{
+        int first  = 0;
+        int second = 0;
+        double delta1 = 0;
+        double delta2 = 0;
+
+        if (!frame_adjust(w, &first, &delta1) || !frame_adjust(w + 4, &second, &delta2))
+                return false;
+
+        if (first != second)
+                return false;
+
+        set_frame_adjust(w, delta1 + delta2);
+        erase(w + 4, 4);
+        return true;
+}
+
+/*
+ * neq / push 0 / je  -->  je
+ *
+ * Jumps if the operands are equal, je compares them the same way.
+ */
+static bool compare_jump(ir_instr **w)
+{
+        if (w[0]->opcode != IR_NEQ || w[1]->opcode != IR_PUSH || w[2]->opcode != IR_JE)
+                return false;
+
+        if (w[1]->arg.kind != IR_ARG_IMM || fpclassify(w[1]->arg.imm) != FP_ZERO)
+                return false;
+
+        erase(w, 2);
+        return true;
+}
+
+/*
+ * jmp L / L:
+ */
+static bool jump_next(ir_instr **w)
+{
+        if (w[0]->opcode != IR_JMP || w[1]->opcode != IR_LABEL)
+                return false;
+
+        if (!same_operand(&w[0]->arg, &w[1]->arg))
+                return false;
+
+        erase(w, 1);
+        return true;
+}
+
+/*
+ * push r / push n / add or sub / pop r
+ */
+static bool frame_adjust(ir_instr **w, int *reg, double *delta)
+{
+        assert(w);
+        assert(reg);
+        assert(delta);
+
+        if (w[0]->opcode != IR_PUSH || w[0]->arg.kind != IR_ARG_REG ||
+            w[1]->opcode != IR_PUSH || w[1]->arg.kind != IR_ARG_IMM ||
+            w[3]->opcode != IR_POP  || w[3]->arg.kind != IR_ARG_REG)
+                return false;
+
+        if (w[0]->arg.base != w[3]->arg.base)
+                return false;
+
+        if (w[2]->opcode == IR_ADD)
+                *delta = w[1]->arg.imm;
+        else if (w[2]->opcode == IR_SUB)
+                *delta = -w[1]->arg.imm;
+        else
+                return false;
+
+        *reg = w[0]->arg.base;
+        return true;
+}
+
+static void set_frame_adjust(ir_instr **w, double delta)
+{
+        assert(w);
+
+        w[1]->arg.imm = delta < 0 ? -delta : delta;
+        w[2]->opcode  = delta < 0 ? IR_SUB : IR_ADD;
+}
+
+static bool reads_register(const ir_operand *arg, int reg)
+{
+        assert(arg);
+
+        switch (arg->kind) {
+        case IR_ARG_REG:
+                return arg->base == reg;
+        case IR_ARG_MEM:
+        case IR_ARG_ADDR:
+                return arg->base == reg || arg->index == reg;
+        default:
+                return false;
+        }
+}
+
+static bool same_string(const char *a, const char *b)
+{
+        if (a == b)
+                return true;
+
+        return a && b && !strcmp(a, b);
+}
+
+static bool same_operand(const ir_operand *a, const ir_operand *b)
+{
+        assert(a);
+        assert(b);
+
+        if (a->kind != b->kind)
+                return false;
+
+        switch (a->kind) {
+        case IR_ARG_IMM:
+                return !memcmp(&a->imm, &b->imm, sizeof(double));
+        case IR_ARG_REG:
+                return a->base == b->base;
+        case IR_ARG_MEM:
+        case IR_ARG_ADDR:
+                return a->base   == b->base  &&
+                       a->index  == b->index &&
+                       a->offset == b->offset;
+        case IR_ARG_LABEL:
+                return a->offset == b->offset &&
+                       same_string(a->name,  b->name) &&
+                       same_string(a->scope, b->scope);
+        case IR_ARG_TEXT:
+                return same_string(a->name, b->name);
+        case IR_ARG_NONE:
+        default:
+                return true;
+        }
+}
+
+static void erase(ir_instr **w, size_t n)
+{
+        assert(w);
+
+        for (size_t i = 0; i < n; i++)
+                w[i]->opcode = DELETED;
+}
+
+/*
+ * Up to 'n' instructions starting from 'i', without comments.
+ */
+static size_t gather(ir_instr *code, size_t size, size_t i, ir_instr **w, size_t n)
+{
+        assert(code);
+        assert(w);
+
+        size_t count = 0;
+        for ( ; i < size && count < n; i++) {
+                if (code[i].opcode == DELETED || code[i].opcode == IR_COMMENT)
+                        continue;
+
+                w[count++] = &code[i];
+        }
+
+        return count;
+}
+
+static size_t compact(array *const code)
+{
+        assert(code);
+
+        ir_instr *instrs = ir_code(code);
+        size_t size = 0;
+
+        for (size_t i = 0; i < code->size; i++) {
+                if (instrs[i].opcode != DELETED)
+                        instrs[size++] = instrs[i];
+        }
+
+        code->size = size;
+        return size;
+}
+
+static size_t count_instrs(const array *const code)
+{
+        assert(code);
+
+        const ir_instr *instrs = (const ir_instr *)code->data;
+        size_t count = 0;
+
+        for (size_t i = 0; i < code->size; i++) {
+                if (instrs[i].opcode != IR_LABEL && instrs[i].opcode != IR_COMMENT)
+                        count++;
+        }
+
+        return count;
+}
@@ -1,9 +1,11 @@
 #include <array.h>
 #include <logs.h>
 #include <assert.h>
-#include <ast/tree.h>
+#include <ast/flat.h>
 #include <backend/scope_table.h>
 
+static var_info *push_entry(scope_table *const table, var_info *info);
+
 void dump_array_var_info(void *item)
 {
         assert(item);
@@ -15,19 +17,16 @@ void dump_array_var_info(void *item)
         fprintf(logs, "%s: [rx + %lu]", info->ident, info->shift);
 }
 
-var_info *scope_table_find(scope_table *const table, ast_node *variable)
+var_info *scope_table_find(scope_table *const table, const char *ident)
 {
         assert(table);
-        assert(variable);
+        assert(ident);
 
-        const char *ident = ast_ident(variable);
-        var_info *vars = (var_info *)(table->entries->data);
-        for (size_t i = 0; i < table->entries->size; i++) {
-                if (vars[i].ident == ident)
-                        return &vars[i];
-        }
+        size_t index = 0;
+        if (!ident_map_find(&table->index, ident, &index))
+                return nullptr;
 
-        return nullptr;
+        return (var_info *)table->entries->data + index;
 }
 
 var_info *scope_table_add_param(scope_table *const table)
@@ -42,7 +41,7 @@ var_info *scope_table_add_param(scope_table *const table)
 
         table->shift++;
 
-        return (var_info *)array_push(table->entries, &info, sizeof(var_info));
+        return push_entry(table, &info);
 }
 
 void scope_table_pop(scope_table *const table)
@@ -55,6 +54,7 @@ $$
 
 $$
         table->shift = info->shift;
+        ident_map_remove(&table->index, info->ident, table->entries->size - 1);
 $$
         array_pop(table->entries, sizeof(var_info));
 $$
@@ -66,22 +66,45 @@ var_info *scope_table_top(scope_table *const table)
         return (var_info *)array_top(table->entries, sizeof(var_info));
 }
 
-var_info *scope_table_add(scope_table *const table, ast_node *variable)
+var_info *scope_table_add(scope_table *const table, const flat_node *variable,
+                          const char *ident, ptrdiff_t length)
 {
         assert(table);
         assert(variable);
+        assert(ident);
 
         var_info info = {0};
 
         info.node  = variable;
-        info.ident = ast_ident(variable);
+        info.ident = ident;
         info.shift = table->shift;
 
-        table->shift++;
-        if (variable->right)
-                table->shift += ast_number(variable->right);
+        table->shift += 1 + length;
+
+        return push_entry(table, &info);
+}
+
+void free_scope_table(scope_table *const table)
+{
+        assert(table);
+        free_ident_map(&table->index);
+}
+
+static var_info *push_entry(scope_table *const table, var_info *info)
+{
+        assert(table);
+        assert(info);
+
+        var_info *entry = (var_info *)array_push(table->entries, info, sizeof(var_info));
+        if (!entry)
+                return nullptr;
+
+        if (ident_map_add(&table->index, entry->ident, table->entries->size - 1)) {
+                array_pop(table->entries, sizeof(var_info));
+                return nullptr;
+        }
 
-        return (var_info *)array_push(table->entries, &info, sizeof(var_info));
+        return entry;
 }
 
 
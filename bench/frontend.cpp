@@ -0,0 +1,603 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <interner.h>
+
+#include <ast/tree.h>
+#include <ast/flat.h>
+#include <ast/binary.h>
+#include <frontend/token.h>
+#include <frontend/keyword.h>
+#include <frontend/compile.h>
+
+/*
+ * Frontend throughput benchmark.
+ *
+ * Generates synthetic programs of several shapes and growing
+ * scale, then times tokenize(), grammar_rule() with and without
+ * a hash-consing table, save_ast_tree(),
+ * read_ast_tree(), save_binary_tree(), read_binary_tree() and
+ * map_binary_tree() separately. Throughput that drops as the scale grows
+ * is a scaling regression.
+ *
+ * Human-readable table goes to stdout, one CSV row per shape,
+ * scale and stage goes to the results file.
+ *
+ * Usage: frontend-bench [-j threads] [-s max_scale] [-r runs] [-o results]
+ */
+
+static const size_t UNIT_SIZE = 32 * 1024;
+
+static const size_t N_FUNC_STMTS = 8;
+static const size_t NEST_DEPTH   = 24;
+static const size_t EXPR_TERMS   = 160;
+static const size_t TABLE_SIZE   = 64;
+
+struct text {
+        char  *buf      = nullptr;
+        size_t size     = 0;
+        size_t capacity = 0;
+};
+
+__attribute__((format(printf, 2, 3)))
+static int emit(text *const txt, const char *fmt, ...)
+{
+        va_list args;
+
+        while (true) {
+                va_start(args, fmt);
+                int n = vsnprintf(txt->buf + txt->size, txt->capacity - txt->size, fmt, args);
+                va_end(args);
+
+                if (n < 0)
+                        return 1;
+
+                if (txt->size + (size_t)n < txt->capacity) {
+                        txt->size += (size_t)n;
+                        return 0;
+                }
+
+                size_t capacity = txt->capacity ? txt->capacity * 2 : UNIT_SIZE;
+                while (capacity <= txt->size + (size_t)n)
+                        capacity *= 2;
+
+                char *buf = (char *)realloc(txt->buf, capacity);
+                if (!buf)
+                        return 1;
+
+                txt->buf      = buf;
+                txt->capacity = capacity;
+        }
+}
+
+/* Deterministic, so every run benchmarks the same program */
+static uint64_t SEED = 0;
+
+static size_t rand_next()
+{
+        SEED ^= SEED << 13;
+        SEED ^= SEED >> 7;
+        SEED ^= SEED << 17;
+        return (size_t)SEED;
+}
+
+static double rand_number()
+{
+        return (double)(rand_next() % 100000) / 100;
+}
+
+/* Many small functions */
+static int gen_functions(text *const txt, size_t unit)
+{
+        int err = emit(txt, "dump f%lu(a, b, c) {\n", unit);
+
+        for (size_t i = 0; i < N_FUNC_STMTS && !err; i++) {
+                err |= emit(txt, "        assert(x%lu = a * %lg + b - c / %lg);\n",
+                            i, rand_number(), rand_number() + 1);
+                err |= emit(txt, "        if (x%lu > %lg && b <= c) {\n"
+                                 "                assert(out(x%lu ^ 2));\n"
+                                 "        } else {\n"
+                                 "                assert(c = f%lu(x%lu, b, c));\n"
+                                 "        }\n",
+                                 i, rand_number(), i, unit, i);
+        }
+
+        err |= emit(txt, "        assert(return a + b + c);\n"
+                         "}\n\n");
+        return err;
+}
+
+/* Deeply nested blocks */
+static int gen_nesting(text *const txt, size_t unit)
+{
+        int err = emit(txt, "dump n%lu(a) {\n", unit);
+
+        for (size_t i = 0; i < NEST_DEPTH && !err; i++) {
+                if (i % 2)
+                        err |= emit(txt, "%*swhile (a > %lg) {\n", (int)i, "", rand_number());
+                else
+                        err |= emit(txt, "%*sif (a < %lg) {\n", (int)i, "", rand_number());
+
+                err |= emit(txt, "%*sassert(a = a - %lu);\n", (int)i + 1, "", i + 1);
+        }
+
+        for (size_t i = NEST_DEPTH; i > 0 && !err; i--) {
+                if (i % 2)
+                        err |= emit(txt, "%*s} else {\n"
+                                         "%*sassert(out(a));\n"
+                                         "%*s}\n",
+                                         (int)i - 1, "", (int)i, "", (int)i - 1, "");
+                else
+                        err |= emit(txt, "%*s}\n", (int)i - 1, "");
+        }
+
+        err |= emit(txt, "        assert(return a);\n"
+                         "}\n\n");
+        return err;
+}
+
+/* Long expressions */
+static int gen_expressions(text *const txt, size_t unit)
+{
+        int err = emit(txt, "assert(e%lu = %lg", unit, rand_number());
+
+        static const char *const ops[] = { " + ", " - ", " * ", " / " };
+
+        for (size_t i = 0; i < EXPR_TERMS && !err; i++) {
+                err |= emit(txt, "%s", ops[rand_next() % 4]);
+
+                switch (rand_next() % 4) {
+                case 0:
+                        err |= emit(txt, "v%lu", rand_next() % 64);
+                        break;
+                case 1:
+                        err |= emit(txt, "(w%lu - %lg) ^ 2", rand_next() % 64, rand_number());
+                        break;
+                case 2:
+                        err |= emit(txt, "sin(t[%lu]) * cos(e%lu)", rand_next() % 64, unit);
+                        break;
+                default:
+                        err |= emit(txt, "%lg", rand_number());
+                        break;
+                }
+
+                if (i % 16 == 15)
+                        err |= emit(txt, "\n       ");
+        }
+
+        err |= emit(txt, ");\n\n");
+        return err;
+}
+
+/* Big constant tables */
+static int gen_constants(text *const txt, size_t unit)
+{
+        int err = 0;
+        for (size_t i = 0; i < TABLE_SIZE && !err; i++) {
+                err |= emit(txt, "assert(inv K%lu_%lu = %lg);\n", unit, i, rand_number());
+                err |= emit(txt, "assert(T%lu[%lu] = K%lu_%lu * %lg);\n",
+                            unit, i, unit, i, rand_number());
+        }
+
+        err |= emit(txt, "\n");
+        return err;
+}
+
+struct shape {
+        const char *name;
+        int (*unit)(text *const txt, size_t unit);
+};
+
+static const shape SHAPES[] = {
+        { "functions",   gen_functions   },
+        { "nesting",     gen_nesting     },
+        { "expressions", gen_expressions },
+        { "constants",   gen_constants   },
+};
+
+static char *generate(const shape *shp, size_t size)
+{
+        SEED = 0x9E3779B97F4A7C15;
+
+        text txt = {};
+        for (size_t unit = 0; txt.size < size; unit++) {
+                if (shp->unit(&txt, unit)) {
+                        free(txt.buf);
+                        return nullptr;
+                }
+        }
+
+        return txt.buf;
+}
+
+static double now()
+{
+        timespec ts = {};
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static size_t N_NODES = 0;
+
+static void count_node(ast_node *)
+{
+        N_NODES++;
+}
+
+static size_t count_nodes(ast_node *tree)
+{
+        N_NODES = 0;
+        visit_tree(tree, count_node);
+        return N_NODES;
+}
+
+static size_t count_tokens(const token *toks)
+{
+        size_t n_toks = 1;
+        while (toks->type != TOKEN_KEYWORD || toks->data.keyword != KW_STOP) {
+                toks++;
+                n_toks++;
+        }
+
+        return n_toks;
+}
+
+struct result {
+        const char *shape = nullptr;
+        const char *stage = nullptr;
+        size_t scale   = 0;
+        double seconds = 0;
+
+        size_t bytes  = 0;
+        size_t tokens = 0;
+        size_t nodes  = 0;
+};
+
+static void report(FILE *csv, const result *res)
+{
+        double bps = (double)res->bytes  / res->seconds;
+        double tps = (double)res->tokens / res->seconds;
+        double nps = (double)res->nodes  / res->seconds;
+
+        printf("%-12s %5lu %-10s %10.6lf sec %9.2lf MB/s %10.0lf tok/s %10.0lf nodes/s\n",
+               res->shape, res->scale, res->stage, res->seconds,
+               bps / (1024 * 1024), tps, nps);
+
+        fprintf(csv, "%s,%lu,%s,%.9lf,%lu,%lu,%lu,%.1lf,%.1lf,%.1lf\n",
+                res->shape, res->scale, res->stage, res->seconds,
+                res->bytes, res->tokens, res->nodes, bps, tps, nps);
+}
+
+static int bench_shape(FILE *csv, const shape *shp, size_t scale,
+                       size_t n_threads, size_t n_runs)
+{
+        char *src = generate(shp, scale * UNIT_SIZE);
+        if (!src)
+                return 1;
+
+        size_t size = strlen(src);
+
+        result lex   = { shp->name, "tokenize", scale, 1e9 };
+        result parse = { shp->name, "parse",    scale, 1e9 };
+        result cparse = { shp->name, "cparse",  scale, 1e9 };
+        result save  = { shp->name, "save",     scale, 1e9 };
+        result read  = { shp->name, "read",     scale, 1e9 };
+        result bsave = { shp->name, "bsave",    scale, 1e9 };
+        result bread = { shp->name, "bread",    scale, 1e9 };
+        result bmap  = { shp->name, "bmap",     scale, 1e9 };
+
+        token    *toks = nullptr;
+        interner names = {};
+        for (size_t i = 0; i < n_runs; i++) {
+                if (toks) {
+                        free(toks);
+                        free_interner(&names);
+                }
+
+                double start = now();
+                toks = tokenize(src, &names, n_threads);
+                double end = now();
+
+                if (!toks) {
+                        free(src);
+                        return 1;
+                }
+
+                if (end - start < lex.seconds)
+                        lex.seconds = end - start;
+        }
+
+        lex.bytes  = size;
+        lex.tokens = count_tokens(toks);
+
+        /* Trees of the previous run are released before the next one */
+        arena trees  = {};
+        arena copies = {};
+
+        ast_node *tree = nullptr;
+        for (size_t i = 0; i < n_runs; i++) {
+                token_stream ts = {};
+                open_token_array(&ts, toks);
+
+                free_tree(&trees);
+                use_ast_arena(&trees);
+
+                double start = now();
+                tree = grammar_rule(&ts);
+                double end = now();
+
+                bool failed = ts.failed;
+                close_token_stream(&ts);
+                if (!tree || failed) {
+                        fprintf(stderr, "Can't parse '%s' program\n", shp->name);
+                        tree = nullptr;
+                        break;
+                }
+
+                if (end - start < parse.seconds)
+                        parse.seconds = end - start;
+        }
+
+        size_t n_consed = 0;
+        for (size_t i = 0; i < n_runs && tree; i++) {
+                token_stream ts = {};
+                open_token_array(&ts, toks);
+
+                arena    consed = {};
+                ast_cons table  = {};
+                use_ast_arena(&consed);
+                use_ast_cons(&table);
+
+                double start = now();
+                ast_node *dag = grammar_rule(&ts);
+                double end = now();
+
+                use_ast_cons(nullptr);
+                use_ast_arena(&trees);
+
+                bool failed = ts.failed;
+                close_token_stream(&ts);
+
+                n_consed = table.size;
+                free_ast_cons(&table);
+                free_tree(&consed);
+                if (!dag || failed) {
+                        fprintf(stderr, "Can't parse '%s' program with a cons table\n",
+                                        shp->name);
+                        tree = nullptr;
+                        break;
+                }
+
+                if (end - start < cparse.seconds)
+                        cparse.seconds = end - start;
+        }
+
+        char  *saved = nullptr;
+        size_t saved_size = 0;
+        for (size_t i = 0; i < n_runs && tree; i++) {
+                if (saved) {
+                        free(saved);
+                }
+
+                FILE *mem = open_memstream(&saved, &saved_size);
+                if (!mem)
+                        break;
+
+                double start = now();
+                save_ast_tree(mem, tree);
+                fflush(mem);
+                double end = now();
+
+                fclose(mem);
+
+                if (end - start < save.seconds)
+                        save.seconds = end - start;
+        }
+
+        size_t n_nodes = 0;
+        for (size_t i = 0; i < n_runs && saved; i++) {
+                interner idents = {};
+                char *reader = saved;
+
+                use_ast_arena(&copies);
+
+                double start = now();
+                ast_node *copy = read_ast_tree(&reader, &idents);
+                double end = now();
+
+                if (copy && !n_nodes)
+                        n_nodes = count_nodes(copy);
+
+                free_tree(&copies);
+                free_interner(&idents);
+                if (!copy) {
+                        fprintf(stderr, "Can't read '%s' tree\n", shp->name);
+                        n_nodes = 0;
+                        break;
+                }
+
+                if (end - start < read.seconds)
+                        read.seconds = end - start;
+        }
+
+        char  *binary = nullptr;
+        size_t binary_size = 0;
+        for (size_t i = 0; i < n_runs && tree; i++) {
+                if (binary) {
+                        free(binary);
+                }
+
+                FILE *mem = open_memstream(&binary, &binary_size);
+                if (!mem)
+                        break;
+
+                double start = now();
+                int error = save_binary_tree(mem, tree);
+                fflush(mem);
+                double end = now();
+
+                fclose(mem);
+                if (error) {
+                        free(binary);
+                        binary = nullptr;
+                        break;
+                }
+
+                if (end - start < bsave.seconds)
+                        bsave.seconds = end - start;
+        }
+
+        size_t n_flat = 0;
+        for (size_t i = 0; i < n_runs && binary; i++) {
+                interner  idents = {};
+                flat_tree flat   = {};
+
+                double start = now();
+                int error = read_binary_tree(binary, binary_size, &idents, &flat);
+                double end = now();
+
+                n_flat = error ? 0 : flat.nodes.size;
+
+                free_flat_tree(&flat);
+                free_interner(&idents);
+                if (error) {
+                        fprintf(stderr, "Can't read '%s' binary tree\n", shp->name);
+                        break;
+                }
+
+                if (end - start < bread.seconds)
+                        bread.seconds = end - start;
+        }
+
+        for (size_t i = 0; i < n_runs && n_flat; i++) {
+                interner  idents = {};
+                flat_tree flat   = {};
+
+                double start = now();
+                int error = map_binary_tree(binary, binary_size, &idents, &flat);
+                double end = now();
+
+                free_flat_tree(&flat);
+                free_interner(&idents);
+                if (error) {
+                        fprintf(stderr, "Can't map '%s' binary tree\n", shp->name);
+                        n_flat = 0;
+                        break;
+                }
+
+                if (end - start < bmap.seconds)
+                        bmap.seconds = end - start;
+        }
+
+        int err = 0;
+        if (tree && n_nodes && n_flat) {
+                parse.bytes  = size;
+                parse.tokens = lex.tokens;
+                parse.nodes  = count_nodes(tree);
+
+                save.bytes  = saved_size;
+                save.nodes  = parse.nodes;
+
+                read.bytes  = saved_size;
+                read.nodes  = n_nodes;
+
+                cparse.bytes  = size;
+                cparse.tokens = lex.tokens;
+                cparse.nodes  = parse.nodes;
+
+                report(csv, &lex);
+                report(csv, &parse);
+                report(csv, &cparse);
+                printf("%-12s %5lu %-10s %lu consed nodes for %lu tree nodes\n",
+                       shp->name, scale, "cparse", n_consed, parse.nodes);
+                report(csv, &save);
+                report(csv, &read);
+
+                bsave.bytes = binary_size;
+                bsave.nodes = parse.nodes;
+                bread.bytes = binary_size;
+                bread.nodes = n_flat;
+
+                bmap.bytes = binary_size;
+                bmap.nodes = n_flat;
+
+                report(csv, &bsave);
+                report(csv, &bread);
+                report(csv, &bmap);
+        } else {
+                err = 1;
+        }
+
+        if (saved) {
+                free(saved);
+        }
+
+        if (binary) {
+                free(binary);
+        }
+
+        use_ast_arena(nullptr);
+        free_tree(&trees);
+
+        free(toks);
+        free_interner(&names);
+        free(src);
+
+        return err;
+}
+
+int main(int argc, char *argv[])
+{
+        size_t n_threads = 1;
+        size_t max_scale = 16;
+        size_t n_runs    = 3;
+        const char *out_file = "frontend-bench.csv";
+
+        int opt = 0;
+        while ((opt = getopt(argc, argv, "j:s:r:o:")) != -1) {
+                switch (opt) {
+                case 'j': n_threads = strtoul(optarg, nullptr, 10); break;
+                case 's': max_scale = strtoul(optarg, nullptr, 10); break;
+                case 'r': n_runs    = strtoul(optarg, nullptr, 10); break;
+                case 'o': out_file  = optarg;                       break;
+                default:
+                        fprintf(stderr, "Usage: frontend-bench [-j threads] [-s max_scale] "
+                                        "[-r runs] [-o results]\n");
+                        return EXIT_FAILURE;
+                }
+        }
+
+        if (!n_threads || !max_scale || !n_runs) {
+                fprintf(stderr, "Threads, scale and runs must be positive\n");
+                return EXIT_FAILURE;
+        }
+
+        FILE *csv = fopen(out_file, "w");
+        if (!csv) {
+                fprintf(stderr, "Can't open %s\n", out_file);
+                return EXIT_FAILURE;
+        }
+
+        fprintf(csv, "shape,scale,stage,seconds,bytes,tokens,nodes,"
+                     "bytes_per_sec,tokens_per_sec,nodes_per_sec\n");
+
+        int err = 0;
+        for (size_t i = 0; i < sizeof(SHAPES) / sizeof(SHAPES[0]) && !err; i++) {
+                for (size_t scale = 1; scale <= max_scale && !err; scale *= 2)
+                        err = bench_shape(csv, &SHAPES[i], scale, n_threads, n_runs);
+        }
+
+        fclose(csv);
+
+        if (err) {
+                fprintf(stderr, "Frontend benchmark failed\n");
+                return EXIT_FAILURE;
+        }
+
+        printf("Results are written to %s\n", out_file);
+        return EXIT_SUCCESS;
+}
@@ -0,0 +1,146 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <time.h>
+#include <skip.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+static inline unsigned long long cycles() { return __rdtsc(); }
+#else
+static inline unsigned long long cycles() { return (unsigned long long)clock(); }
+#endif
+
+/*
+ * Whitespace and comment skipping microbenchmark.
+ *
+ * Walks heavily indented and commented text the way tokenize() does:
+ * runs of spaces and comment bodies are skipped, every other
+ * character is stepped over one by one.
+ */
+
+static const size_t BENCH_SIZE = 64 * 1024 * 1024;
+static const int    N_RUNS     = 5;
+
+static char *generate(size_t size)
+{
+        char *text = (char *)calloc(size + 1, sizeof(char));
+        if (!text)
+                return nullptr;
+
+        static const char *const lines[] = {
+                "        assert(x = x + 1);\n",
+                "                # walks through the whole screen and draws the circle #\n",
+                "\t\t\tif (phi < 6.28) {\n",
+                "                                                \n",
+                "        # ------------------------------------------------------------ #\n",
+                "                                assert(screen[y * SIZE + x] = 1);\n",
+        };
+
+        const size_t n_lines = sizeof(lines) / sizeof(lines[0]);
+
+        size_t pos = 0;
+        for (size_t i = 0; ; i++) {
+                const char *line = lines[i % n_lines];
+                size_t len = strlen(line);
+                if (pos + len > size)
+                        break;
+
+                memcpy(text + pos, line, len);
+                pos += len;
+        }
+
+        return text;
+}
+
+/* What tokenize() did before: one isspace() and one '#' check per byte */
+static size_t walk_bytewise(const char *str)
+{
+        size_t n_tokens = 0;
+        bool comment = false;
+        while (*str != '\0') {
+                if (*str == '#') {
+                        comment = !comment;
+                        str++;
+                        continue;
+                }
+
+                if (comment || isspace(*str)) {
+                        str++;
+                        continue;
+                }
+
+                n_tokens++;
+                str++;
+        }
+
+        return n_tokens;
+}
+
+static size_t walk_skip(const char *str)
+{
+        size_t n_tokens = 0;
+        while (*str != '\0') {
+                if (*str == '#') {
+                        str = skip_until(str + 1, '#');
+                        if (*str == '#')
+                                str++;
+                        continue;
+                }
+
+                if (isspace(*str)) {
+                        str = skip_spaces(str);
+                        continue;
+                }
+
+                n_tokens++;
+                str++;
+        }
+
+        return n_tokens;
+}
+
+static void measure(const char *name, size_t (*walk)(const char *),
+                    const char *text, size_t size)
+{
+        unsigned long long best = ~0ull;
+        size_t n_tokens = 0;
+
+        for (int i = 0; i < N_RUNS; i++) {
+                unsigned long long start = cycles();
+                n_tokens = walk(text);
+                unsigned long long end = cycles();
+
+                if (end - start < best)
+                        best = end - start;
+        }
+
+        printf("%-10s %12lu bytes %12llu cycles %8.3lf bytes/cycle (%lu chars)\n",
+               name, size, best, (double)size / (double)best, n_tokens);
+}
+
+int main()
+{
+        char *text = generate(BENCH_SIZE);
+        if (!text) {
+                fprintf(stderr, "Can't allocate benchmark text\n");
+                return EXIT_FAILURE;
+        }
+
+        size_t size = strlen(text);
+
+        measure("bytewise", walk_bytewise, text, size);
+
+        skip_impl impls[] = { SKIP_SCALAR, SKIP_SSE2, SKIP_AVX2 };
+        for (size_t i = 0; i < sizeof(impls) / sizeof(impls[0]); i++) {
+                skip_impl impl = use_skip_impl(impls[i]);
+                if (impl != impls[i])
+                        continue;
+
+                measure(skip_impl_string(impl), walk_skip, text, size);
+        }
+
+        free(text);
+        return EXIT_SUCCESS;
+}
@@ -1,7 +1,64 @@
 #include <assert.h>
 #include <stdio.h>
+#include <phash.h>
 #include <frontend/keyword.h>
 
+#define KEYWORD(name, keyword, ident) { ident, sizeof(ident) - 1, KW_##name },
+
+static constexpr phash_key LINKABLE_KEYS[] = {
+#define   LINKABLE(xxx) xxx
+#define UNLINKABLE(xxx)
+#include "../KEYWORDS"
+#undef LINKABLE
+#undef UNLINKABLE
+};
+
+static constexpr phash_key UNLINKABLE_KEYS[] = {
+#define   LINKABLE(xxx)
+#define UNLINKABLE(xxx) xxx
+#include "../KEYWORDS"
+#undef LINKABLE
+#undef UNLINKABLE
+};
+
+#undef KEYWORD
+
+static constexpr size_t N_LINKABLE   = sizeof(LINKABLE_KEYS)   / sizeof(phash_key);
+static constexpr size_t N_UNLINKABLE = sizeof(UNLINKABLE_KEYS) / sizeof(phash_key);
+
+static_assert(N_LINKABLE   < PHASH_SIZE / 2, "Too many linkable keywords");
+static_assert(N_UNLINKABLE < PHASH_SIZE / 2, "Too many unlinkable keywords");
+
+static constexpr phash_table LINKABLE_TABLE =
+        make_phash_table(LINKABLE_KEYS, N_LINKABLE);
+
+static constexpr prefix_table UNLINKABLE_TABLE =
+        make_prefix_table(UNLINKABLE_KEYS, N_UNLINKABLE);
+
+int find_keyword(const char *str, size_t length)
+{
+        assert(str);
+
+        const phash_key *key = phash_find(&LINKABLE_TABLE, str, length);
+        if (!key)
+                return -1;
+
+        return key->id;
+}
+
+int match_keyword(const char *str, size_t *length)
+{
+        assert(str);
+        assert(length);
+
+        const phash_key *key = prefix_find(&UNLINKABLE_TABLE, str);
+        if (!key)
+                return -1;
+
+        *length = key->length;
+        return key->id;
+}
+
 const char *keyword_string(int id)
 {
 #define   LINKABLE(xxx) xxx
@@ -4,9 +4,18 @@
 #include <string.h>
 #include <stddef.h>
 #include <stdlib.h>
+#include <errno.h>
+#include <unistd.h>
 #include <logs.h>
 #include <list.h>
 #include <array.h>
+#include <interner.h>
+#include <number.h>
+#include <skip.h>
+#include <parallel.h>
+#include <ring_buffer.h>
+#include <pthread.h>
+#include <sched.h>
 #include <ast/tree.h>
 
 #include <frontend/token.h>
@@ -18,102 +27,427 @@ static token  *core_error() { return nullptr; }
 static token *create_keyword(array *const tokens, int keyword);
 static token *create_number (array *const tokens, const char **str);
 static token *create_ident(array *const tokens, const char *str, 
-                           array *const idents, const size_t len);
+                           interner *const idents, const size_t len);
 
 static token *read_keyword(array *const tokens, const char *str, 
-                           array *const idents, size_t length);
+                           interner *const idents, size_t length);
 
-token *tokenize(const char *str, array *const idents)
+/* Smaller sources are not worth the threads */
+static const size_t MIN_CHUNK_SIZE = 64 * 1024;
+static const size_t CHUNKS_PER_THREAD = 4;
+
+struct lex_chunk {
+        const char *begin = nullptr;
+        const char *end   = nullptr;
+
+        array tokens   = {};
+        array offsets  = {};
+        interner cache = {};
+};
+
+struct lex_job {
+        lex_chunk *chunks = nullptr;
+        interner  *idents = nullptr;
+
+        /* Offsets are taken from it if set */
+        const char *origin = nullptr;
+};
+
+static void lex_range(array *const tokens, const char *str, 
+                      const char *end, interner *const idents,
+                      array *const offsets = nullptr, 
+                      const char *origin   = nullptr);
+
+static lex_chunk *split_chunks(const char *str, size_t size, size_t *n_chunks);
+static void free_chunks(lex_chunk *chunks, size_t n_chunks);
+
+static token create_stop()
+{
+        token stop = {};
+        stop.type         = TOKEN_KEYWORD;
+        stop.data.keyword = KW_STOP;
+
+        return stop;
+}
+
+static inline bool is_stop(const token *tok)
+{
+        assert(tok);
+        return tok->type == TOKEN_KEYWORD && tok->data.keyword == KW_STOP;
+}
+
+static token *tokenize_parallel(const char *str, size_t size,
+                                interner *const idents, size_t n_threads);
+
+token *tokenize_views(char *str, interner *const idents, size_t n_threads)
+{
+        assert(str);
+        assert(idents);
+
+        idents->views = true;
+
+        token *toks = tokenize(str, idents, n_threads);
+        if (!toks)
+                return nullptr;
+
+        seal_views(idents, str);
+        return toks;
+}
+
+token *tokenize(const char *str, interner *const idents, size_t n_threads)
 {
         assert(str);
         assert(idents);
 
+        size_t size = strlen(str);
+        if (n_threads > 1 && size >= 2 * MIN_CHUNK_SIZE)
+                return tokenize_parallel(str, size, idents, n_threads);
+
         array tokens = {0};
 
+        lex_range(&tokens, str, str + size, idents);
+        create_keyword(&tokens, KW_STOP);
+
+        token *toks = (token *)array_extract(&tokens, sizeof(token));
+        if (!toks)
+                return core_error();
+
+        return toks;
+}
+
+static inline void mark_offset(array *const offsets, const char *origin, 
+                               const char *str)
+{
+        if (!offsets)
+                return;
+
+        size_t offset = (size_t)(str - origin);
+        array_push(offsets, &offset, sizeof(size_t));
+}
+
+/*
+ * Lexes [str, end). If 'offsets' is given, the offset of
+ * every token from 'origin' is pushed there.
+ */
+static void lex_range(array *const tokens, const char *str, 
+                      const char *end, interner *const idents,
+                      array *const offsets, const char *origin)
+{
+        assert(tokens);
+        assert(str);
+        assert(end);
+        assert(idents);
+        assert(!offsets || origin);
+
         const char *start = str;
 
-        bool comment = false;
-        while (*str != '\0') {
-                if (*str == '#')
-                        comment = !comment;
+        while (str < end) {
+                /* Comments are enclosed in '#' and separate tokens */
+                if (*str == '#') {
+                        if (start != str) {
+                                mark_offset(offsets, origin, start);
+                                read_keyword(tokens, start, 
+                                              idents, (size_t)(str - start));
+                        }
+                        str = skip_until(str + 1, '#');
+                        if (*str == '#')
+                                str++;
 
-                if (comment) {
-                        str++;
+                        start = str;
                         continue;
                 }
 
                 if (isspace(*str)) {
                         if (start != str) {
-                                read_keyword(&tokens, start, 
+                                mark_offset(offsets, origin, start);
+                                read_keyword(tokens, start, 
                                               idents, (size_t)(str - start));
                         }
-                        start = ++str;
+                        start = str = skip_spaces(str);
                         continue;
                 }
 
-#define LINKABLE(xxx)
-#define UNLINKABLE(xxx) xxx
-#define KEYWORD(name, keyword, ident)                                          \
-                else if (!strncmp(ident, str, sizeof(ident) - 1)) {            \
-                        if (start != str)                                      \
-                                read_keyword(&tokens, start,                   \
-                                              idents, (size_t)(str - start));  \
-                        create_keyword(&tokens, keyword);                      \
-                        str += sizeof(ident) - 1;                              \
-                        start = str;                                           \
-                        continue;                                              \
+                size_t length = 0;
+                int keyword = match_keyword(str, &length);
+                if (keyword != -1) {
+                        if (start != str) {
+                                mark_offset(offsets, origin, start);
+                                read_keyword(tokens, start, 
+                                              idents, (size_t)(str - start));
+                        }
+                        mark_offset(offsets, origin, str);
+                        create_keyword(tokens, keyword);
+                        str += length;
+                        start = str;
+                        continue;
                 }
 
-                if (0) {} 
-#include "../KEYWORDS"
-#undef LINKABLE
-#undef UNLINKABLE 
-#undef KEYWORD 
-
                 if (isdigit(*str) && start == str) {
-                        create_number(&tokens, &str);
+                        mark_offset(offsets, origin, str);
+                        create_number(tokens, &str);
                         start = str;
                         continue;
                 }
 
                 str++;
         }
+}
 
-        create_keyword(&tokens, KW_STOP);
+/*
+ * Top-level 'dump' or 'assert' preceded by a space.
+ * Lexer state is empty there, so lexing can start from it.
+ */
+static bool is_split_point(const char *str)
+{
+        assert(str);
+
+        if (!isspace(str[-1]))
+                return false;
+
+        size_t length = 0;
+        if (!strncmp(str, "dump", 4))
+                length = 4;
+        else if (!strncmp(str, "assert", 6))
+                length = 6;
+        else
+                return false;
+
+        char next = str[length];
+        size_t unused = 0;
+        return next == '\0' || next == '#' || isspace(next) || 
+               match_keyword(str + length, &unused) != -1;
+}
+
+/*
+ * Walks the source tracking comments and braces and puts 
+ * a split at the first top-level statement after every 
+ * 'size / n_chunks' bytes. Returns the number of chunks.
+ */
+static size_t split_source(const char *str, size_t size, 
+                           lex_chunk *chunks, size_t n_chunks)
+{
+        assert(str);
+        assert(chunks);
+
+        const char *end    = str + size;
+        const char *iter   = str;
+        const char *target = str + size / n_chunks;
+
+        size_t n_splits = 0;
+        chunks[0].begin = str;
+
+        long depth = 0;
+        while (iter < end && n_splits + 1 < n_chunks) {
+                /* Only comments and braces matter until a split is due */
+                if (iter < target || depth != 0) {
+                        iter += strcspn(iter, "#{}");
+                        if (iter >= end)
+                                break;
+                }
+
+                if (*iter == '#') {
+                        iter = skip_until(iter + 1, '#');
+                        if (*iter == '#')
+                                iter++;
+                        continue;
+                }
+
+                if (*iter == '{')
+                        depth++;
+                else if (*iter == '}')
+                        depth--;
+
+                if (iter >= target && depth == 0 && is_split_point(iter)) {
+                        chunks[n_splits].end = iter;
+                        n_splits++;
+                        chunks[n_splits].begin = iter;
+
+                        target = str + size / n_chunks * (n_splits + 1);
+                }
+
+                iter++;
+        }
+
+        chunks[n_splits].end = end;
+        return n_splits + 1;
+}
+
+static void lex_chunk_task(void *arg, size_t index)
+{
+        assert(arg);
+
+        lex_job *job = (lex_job *)arg;
+        lex_chunk *chunk = &job->chunks[index];
+
+        chunk->cache.parent = job->idents;
+        lex_range(&chunk->tokens, chunk->begin, chunk->end, &chunk->cache,
+                  job->origin ? &chunk->offsets : nullptr, job->origin);
+}
+
+static lex_chunk *split_chunks(const char *str, size_t size, size_t *n_chunks)
+{
+        assert(str);
+        assert(n_chunks);
+        assert(*n_chunks);
+
+        lex_chunk *chunks = (lex_chunk *)calloc(*n_chunks, sizeof(lex_chunk));
+        if (!chunks)
+                return nullptr;
+
+        for (size_t i = 0; i < *n_chunks; i++)
+                chunks[i] = {};
+
+        *n_chunks = split_source(str, size, chunks, *n_chunks);
+        return chunks;
+}
+
+static void free_chunks(lex_chunk *chunks, size_t n_chunks)
+{
+        assert(chunks);
+
+        for (size_t i = 0; i < n_chunks; i++) {
+                free_array(&chunks[i].tokens,  sizeof(token));
+                free_array(&chunks[i].offsets, sizeof(size_t));
+                free_interner(&chunks[i].cache);
+        }
+
+        free(chunks);
+}
+
+/*
+ * Chunks are lexed with thread-local interner caches in front of
+ * 'idents' and their tokens are stitched together in order.
+ */
+static token *tokenize_parallel(const char *str, size_t size,
+                                interner *const idents, size_t n_threads)
+{
+        assert(str);
+        assert(idents);
+
+        size_t n_chunks = n_threads * CHUNKS_PER_THREAD;
+        if (n_chunks > size / MIN_CHUNK_SIZE)
+                n_chunks = size / MIN_CHUNK_SIZE;
+
+        lex_chunk *chunks = split_chunks(str, size, &n_chunks);
+        if (!chunks)
+                return core_error();
+
+        lex_job job = {};
+        job.chunks = chunks;
+        job.idents = idents;
+
+        parallel_for(n_chunks, n_threads, lex_chunk_task, &job);
+
+        size_t n_tokens = 1;
+        for (size_t i = 0; i < n_chunks; i++)
+                n_tokens += chunks[i].tokens.size;
+
+        token *toks = (token *)calloc(n_tokens, sizeof(token));
+        if (toks) {
+                token *iter = toks;
+                for (size_t i = 0; i < n_chunks; i++) {
+                        if (chunks[i].tokens.size) {
+                                memcpy(iter, chunks[i].tokens.data, 
+                                       chunks[i].tokens.size * sizeof(token));
+                        }
+                        iter += chunks[i].tokens.size;
+                }
+
+                *iter = create_stop();
+        }
+
+        free_chunks(chunks, n_chunks);
 
-        token *toks = (token *)array_extract(&tokens, sizeof(token));
         if (!toks)
                 return core_error();
 
         return toks;
 }
 
+/*
+ * Chunks are encoded in order as soon as they are lexed, 
+ * so only one chunk of full tokens exists at a time
+ * (all of them if lexed in parallel).
+ */
+int tokenize_compact(token_buffer *const buf, char *str, 
+                     interner *const idents, size_t n_threads)
+{
+        assert(buf);
+        assert(str);
+        assert(idents);
+
+        *buf = {};
+        buf->idents = idents;
+        idents->views = true;
+
+        size_t size = strlen(str);
+        size_t n_chunks = size / MIN_CHUNK_SIZE + 1;
+        bool parallel = n_threads > 1 && size >= 2 * MIN_CHUNK_SIZE;
+        if (parallel && n_chunks > n_threads * CHUNKS_PER_THREAD)
+                n_chunks = n_threads * CHUNKS_PER_THREAD;
+
+        lex_chunk *chunks = split_chunks(str, size, &n_chunks);
+        if (!chunks)
+                return 1;
+
+        if (parallel) {
+                lex_job job = {};
+                job.chunks = chunks;
+                job.idents = idents;
+                job.origin = str;
+
+                parallel_for(n_chunks, n_threads, lex_chunk_task, &job);
+        }
+
+        int error = 0;
+        for (size_t i = 0; i < n_chunks && !error; i++) {
+                lex_chunk *chunk = &chunks[i];
+                if (!parallel) {
+                        lex_range(&chunk->tokens, chunk->begin, chunk->end, 
+                                  idents, &chunk->offsets, str);
+                }
+
+                error = append_tokens(buf, (const token *)chunk->tokens.data,
+                                      (const size_t *)chunk->offsets.data, chunk->tokens.size) ||
+                        append_lines(buf, str, (size_t)(chunk->end - str));
+
+                free_array(&chunk->tokens,  sizeof(token));
+                free_array(&chunk->offsets, sizeof(size_t));
+        }
+
+        free_chunks(chunks, n_chunks);
+
+        if (!error) {
+                token stop = create_stop();
+                error = append_tokens(buf, &stop, &size, 1);
+        }
+
+        /* Lines are known, views can be sealed now */
+        seal_views(idents, str);
+
+        if (error) {
+                free_token_buffer(buf);
+                return 1;
+        }
+
+        return 0;
+}
+
 static token *read_keyword(array *const tokens, const char *str, 
-                           array *const idents, size_t length) 
+                           interner *const idents, size_t length) 
 {
         assert(tokens);
         assert(idents);
         assert(str);
 
+        int keyword = find_keyword(str, length);
+        if (keyword != -1) {
+                token *newbie = create_keyword(tokens, keyword);
+                if (!newbie)
+                        return core_error();
 
-#define LINKABLE(xxx) xxx
-#define UNLINKABLE(xxx) 
-#define KEYWORD(name, keyword, ident)                                             \
-                if (sizeof(ident) - 1 == length) {                                \
-                        if (!strncmp(ident, str, length)) {                       \
-                                token *newbie = create_keyword(tokens, keyword);  \
-                                if (!newbie)                                      \
-                                        return core_error();                      \
-                                                                                  \
-                                return newbie;                                    \
-                        }                                                         \
-                }
-
-                if (0) {} 
-#include "../KEYWORDS"
-#undef LINKABLE
-#undef UNLINKABLE 
-#undef KEYWORD 
+                return newbie;
+        }
 
         token *ident = create_ident(tokens, str, idents, length);
         if (!ident)
@@ -129,6 +463,7 @@ static token *create_token(array *const tokens, int type)
         token *newbie = (token *)array_create(tokens, sizeof(token));
 
         newbie->type       = type;
+        newbie->length     = 0;
         newbie->data.ident = nullptr;
 
         return newbie;
@@ -147,37 +482,22 @@ static token *create_keyword(array *const tokens, int keyword)
         return newbie;
 }
 
-static token *create_ident(array *const tokens, const char *str, array *const idents, const size_t len)
+static token *create_ident(array *const tokens, const char *str, interner *const idents, const size_t len)
 {
         assert(str);
         assert(tokens);
         assert(idents);
 
-        char *ident = nullptr;
-        char **keys = (char **)idents->data;
-        for (size_t i = 0; i < idents->size; i++) {
-                if (strlen(keys[i]) == len && !strncmp(keys[i], str, len)) {
-                        ident = keys[i];
-                        break;
-                }
-        }
-
-        if (!ident) {
-                ident = (char *)calloc(len + 1, sizeof(char));
-                if (!ident)
-                        return core_error();
-
-                strncpy(ident, str, len);
-                ident[len] = '\0';
-
-                array_push(idents, &ident, sizeof(char *));
-        }
+        const char *ident = intern(idents, str, len);
+        if (!ident)
+                return core_error();
 
         token *newbie = create_token(tokens, TOKEN_IDENT);
         if (!newbie)
                 return core_error();
 
         newbie->data.ident = ident;
+        newbie->length     = (uint32_t)len;
 
         return newbie;
 }
@@ -188,20 +508,424 @@ static token *create_number(array *const tokens, const char **str)
         assert(tokens);
 
         double number = 0;
-        int n_skip = 0;
+        size_t length = scan_number(*str, &number);
+        if (!length)
+                return lexer_error(*str);
 
-        sscanf(*str, "%lf%n", &number, &n_skip);
         token *newbie = create_token(tokens, TOKEN_NUMBER);
         if (!newbie)
                 return core_error();
 
         newbie->data.number = number;
 
-        *str += n_skip;
+        *str += length;
 
         return newbie;
 }
 
+/* Reads past the end of the window stay inside the allocation */
+static const size_t WINDOW_PAD = 64;
+
+/* Tokens in flight between the lexer and the parser threads */
+static const size_t PIPE_CAPACITY = 4096;
+static const size_t PIPE_BATCH    = 256;
+
+/* Tokens decoded from a token buffer at once */
+static const size_t DECODE_BATCH  = 256;
+
+struct token_pipe {
+        ring_buffer ring    = {};
+        token_stream source = {};
+        pthread_t lexer     = {};
+
+        /* Shared between the threads, accessed atomically */
+        bool stop   = false;
+        bool failed = false;
+};
+
+static const token *stop_token()
+{
+        static const token stop = create_stop();
+        return &stop;
+}
+
+
+void open_token_array(token_stream *const ts, const token *toks)
+{
+        assert(ts);
+        assert(toks);
+
+        *ts = {};
+        ts->toks = toks;
+        ts->eof  = true;
+
+        while (!is_stop(&toks[ts->n_toks]))
+                ts->n_toks++;
+
+        ts->n_toks++;
+}
+
+void open_token_buffer(token_stream *const ts, const token_buffer *buf)
+{
+        assert(ts);
+        assert(buf);
+
+        *ts = {};
+        ts->buffer = buf;
+}
+
+int open_token_stream(token_stream *const ts, int fd, interner *const idents,
+                      size_t window)
+{
+        assert(ts);
+        assert(idents);
+        assert(window);
+
+        *ts = {};
+        ts->fd       = fd;
+        ts->idents   = idents;
+        ts->capacity = window;
+
+        char *buf = (char *)calloc(window + WINDOW_PAD, sizeof(char));
+        if (!buf)
+                return 1;
+
+        ts->window = buf;
+        return 0;
+}
+
+void close_token_stream(token_stream *const ts)
+{
+        assert(ts);
+
+        if (ts->pipe) {
+                token_pipe *pipe = ts->pipe;
+
+                __atomic_store_n(&pipe->stop, true, __ATOMIC_RELAXED);
+                pthread_join(pipe->lexer, nullptr);
+
+                close_token_stream(&pipe->source);
+                delete_ring_buffer(&pipe->ring);
+                free(pipe);
+        }
+
+        if (ts->window) {
+                free(ts->window);
+        }
+
+        free_array(&ts->tokens, sizeof(token));
+        *ts = {};
+}
+
+static int fill_window(token_stream *const ts)
+{
+        assert(ts);
+
+        while (!ts->eof && ts->filled < ts->capacity) {
+                ssize_t n_read = read(ts->fd, ts->window + ts->filled, 
+                                              ts->capacity - ts->filled);
+                if (n_read < 0) {
+                        if (errno == EINTR)
+                                continue;
+
+                        fprintf(stderr, "Can't read source: %s\n", strerror(errno));
+                        return 1;
+                }
+
+                if (n_read == 0)
+                        ts->eof = true;
+
+                ts->filled += (size_t)n_read;
+        }
+
+        ts->window[ts->filled] = '\0';
+        return 0;
+}
+
+/*
+ * Lexer state is empty right after a space or a comment.
+ * Returns the last such position in the window, 
+ * nullptr if there is none.
+ */
+static const char *find_cut(const char *begin, const char *end)
+{
+        assert(begin);
+        assert(end);
+
+        /* Window starts outside of comments, so '#' pair up from it */
+        const char *limit = end;
+        const char *iter  = skip_until(begin, '#');
+        while (iter < end) {
+                const char *open = iter;
+
+                iter = skip_until(iter + 1, '#');
+                if (iter >= end) {
+                        limit = open;
+                        break;
+                }
+
+                iter = skip_until(iter + 1, '#');
+        }
+
+        /* The first '#' met backwards closes a comment */
+        for (const char *cut = limit; cut > begin; cut--) {
+                if (isspace(cut[-1]) || cut[-1] == '#')
+                        return cut;
+        }
+
+        return nullptr;
+}
+
+static int grow_window(token_stream *const ts)
+{
+        assert(ts);
+
+        size_t capacity = ts->capacity * 2;
+
+        char *buf = (char *)realloc(ts->window, capacity + WINDOW_PAD);
+        if (!buf)
+                return 1;
+
+        ts->window   = buf;
+        ts->capacity = capacity;
+
+        return 0;
+}
+
+/*
+ * Moves tokens not consumed yet to the front for the lookahead.
+ */
+static void keep_lookahead(token_stream *const ts)
+{
+        assert(ts);
+
+        token *toks = (token *)ts->tokens.data;
+        size_t left = ts->tokens.size - ts->current;
+        if (left)
+                memmove(toks, toks + ts->current, left * sizeof(token));
+
+        /* Tokens are plain data, the array is reused in place */
+        ts->tokens.size = left;
+        ts->current = 0;
+}
+
+/*
+ * Lexes the window up to the last cut and carries the rest over.
+ */
+static int lex_window(token_stream *const ts)
+{
+        assert(ts);
+
+        keep_lookahead(ts);
+
+        const char *cut = nullptr;
+        while (true) {
+                if (fill_window(ts))
+                        return 1;
+
+                cut = ts->eof ? ts->window + ts->filled : 
+                                find_cut(ts->window, ts->window + ts->filled);
+                if (cut)
+                        break;
+
+                /* Single lexeme or comment is longer than the window */
+                if (grow_window(ts))
+                        return 1;
+        }
+
+        lex_range(&ts->tokens, ts->window, cut, ts->idents);
+
+        size_t tail = ts->filled - (size_t)(cut - ts->window);
+        memmove(ts->window, cut, tail);
+        ts->filled = tail;
+        ts->window[ts->filled] = '\0';
+
+        if (ts->eof && !ts->filled) {
+                if (!create_keyword(&ts->tokens, KW_STOP))
+                        return 1;
+        }
+
+        ts->toks   = (const token *)ts->tokens.data;
+        ts->n_toks = ts->tokens.size;
+
+        return 0;
+}
+
+static void *pipe_lexer(void *arg)
+{
+        assert(arg);
+        token_pipe *pipe = (token_pipe *)arg;
+
+        const token *tok = peek_token(&pipe->source);
+        while (true) {
+                token copy = *tok;
+                if (is_stop(&copy) && pipe->source.failed)
+                        __atomic_store_n(&pipe->failed, true, __ATOMIC_RELAXED);
+
+                while (!ring_buffer_push(&pipe->ring, &copy)) {
+                        if (__atomic_load_n(&pipe->stop, __ATOMIC_RELAXED))
+                                return nullptr;
+
+                        sched_yield();
+                }
+
+                if (is_stop(&copy))
+                        return nullptr;
+
+                tok = next_token(&pipe->source);
+        }
+}
+
+int open_token_pipe(token_stream *const ts, int fd, interner *const idents,
+                    size_t window)
+{
+        assert(ts);
+        assert(idents);
+
+        *ts = {};
+
+        token_pipe *pipe = (token_pipe *)calloc(1, sizeof(token_pipe));
+        if (!pipe)
+                return 1;
+
+        *pipe = {};
+        if (!create_ring_buffer(&pipe->ring, PIPE_CAPACITY, sizeof(token))) {
+                free(pipe);
+                return 1;
+        }
+
+        if (open_token_stream(&pipe->source, fd, idents, window) ||
+            pthread_create(&pipe->lexer, nullptr, pipe_lexer, pipe)) {
+                close_token_stream(&pipe->source);
+                delete_ring_buffer(&pipe->ring);
+                free(pipe);
+                return 1;
+        }
+
+        ts->pipe = pipe;
+        return 0;
+}
+
+/*
+ * Takes whatever the lexer thread has produced, 
+ * waits only if there is nothing at all.
+ */
+static int pipe_window(token_stream *const ts)
+{
+        assert(ts);
+        assert(ts->pipe);
+
+        keep_lookahead(ts);
+
+        token tok = {};
+        size_t n_popped = 0;
+        while (n_popped < PIPE_BATCH) {
+                if (!ring_buffer_pop(&ts->pipe->ring, &tok)) {
+                        if (n_popped)
+                                break;
+
+                        sched_yield();
+                        continue;
+                }
+
+                if (!array_push(&ts->tokens, &tok, sizeof(token)))
+                        return 1;
+
+                n_popped++;
+
+                if (is_stop(&tok)) {
+                        ts->eof = true;
+                        if (__atomic_load_n(&ts->pipe->failed, __ATOMIC_RELAXED))
+                                return 1;
+
+                        break;
+                }
+        }
+
+        ts->toks   = (const token *)ts->tokens.data;
+        ts->n_toks = ts->tokens.size;
+
+        return 0;
+}
+
+static int decode_window(token_stream *const ts)
+{
+        assert(ts);
+        assert(ts->buffer);
+
+        keep_lookahead(ts);
+
+        const token_buffer *buf = ts->buffer;
+        for (size_t i = 0; i < DECODE_BATCH && ts->decoded < buf->size; i++) {
+                token tok = decode_token(buf, ts->decoded++);
+                if (!array_push(&ts->tokens, &tok, sizeof(token)))
+                        return 1;
+        }
+
+        if (ts->decoded == buf->size)
+                ts->eof = true;
+
+        ts->toks   = (const token *)ts->tokens.data;
+        ts->n_toks = ts->tokens.size;
+
+        return 0;
+}
+
+int stream_location(token_stream *const ts, size_t *line, size_t *column)
+{
+        assert(ts);
+        assert(line);
+        assert(column);
+
+        if (!ts->buffer || ts->current >= ts->n_toks)
+                return 1;
+
+        size_t index = ts->decoded - ts->n_toks + ts->current;
+        return token_location(ts->buffer, index, line, column);
+}
+
+const token *peek_token(token_stream *const ts, size_t ahead)
+{
+        assert(ts);
+
+        while (ts->current + ahead >= ts->n_toks) {
+                if (ts->failed)
+                        return stop_token();
+
+                if (ts->eof && !ts->filled) {
+                        if (!ts->n_toks)
+                                return stop_token();
+
+                        return &ts->toks[ts->n_toks - 1];
+                }
+
+                int error = 0;
+                if (ts->buffer)
+                        error = decode_window(ts);
+                else if (ts->pipe)
+                        error = pipe_window(ts);
+                else
+                        error = lex_window(ts);
+
+                if (error)
+                        ts->failed = true;
+        }
+
+        return &ts->toks[ts->current + ahead];
+}
+
+const token *next_token(token_stream *const ts)
+{
+        assert(ts);
+
+        const token *tok = peek_token(ts, 0);
+        if (is_stop(tok))
+                return tok;
+
+        ts->current++;
+        return peek_token(ts, 0);
+}
+
 void dump_tokens(const token *toks)
 {
         assert(toks);
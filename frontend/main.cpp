@@ -3,24 +3,72 @@
 #include <stdlib.h>
 #include <logs.h>
 #include <array.h>
+#include <interner.h>
 #include <errno.h>
 #include <iommap.h>
+#include <parallel.h>
 #include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 #include <ast/tree.h>
+#include <ast/binary.h>
 #include <frontend/token.h>
 #include <frontend/compile.h>
 
 static int input_error();
 static int file_error(const char *file_name);
 
+/*
+ * Usage: tr [-j threads] [-s | -p] [-t] [-c] source tree
+ *
+ *      -j  lex on 'threads' threads, all processors by default
+ *      -s  stream the source through a fixed-size window
+ *          instead of mapping it and lexing it at once
+ *      -p  same as -s, but lex on a separate thread 
+ *          while parsing
+ *      -t  save the text tree instead of the binary one,
+ *          for debugging
+ *      -c  share repeated subexpressions while parsing
+ */
 int main(int argc, char *argv[])
 {
-        if (argc != 3)
+        size_t n_threads = online_cpus();
+        bool   stream    = false;
+        bool   piped     = false;
+        bool   text      = false;
+        bool   consed    = false;
+
+        int opt = 0;
+        while ((opt = getopt(argc, argv, "j:sptc")) != -1) {
+                switch (opt) {
+                case 'j':
+                        n_threads = strtoul(optarg, nullptr, 10);
+                        if (!n_threads)
+                                return input_error();
+                        break;
+                case 's':
+                        stream = true;
+                        break;
+                case 'p':
+                        stream = piped = true;
+                        break;
+                case 't':
+                        text = true;
+                        break;
+                case 'c':
+                        consed = true;
+                        break;
+                default:
+                        return input_error();
+                }
+        }
+
+        if (argc - optind != 2)
                 return input_error();
 
-        const char *src_file  = argv[1];
-        const char *tree_file = argv[2];
+        const char *src_file  = argv[optind];
+        const char *tree_file = argv[optind + 1];
 
         FILE *out = fopen(tree_file, "w");
         if (!out)
@@ -29,35 +77,69 @@ int main(int argc, char *argv[])
         clock_t init = clock();
         clock_t start = clock();
         mmap_data md = {0};
-        int error = mmap_in(&md, src_file);
-        if (error)
-                return EXIT_FAILURE;
-
-        array names = {0};
+        int fd = -1;
+
+        interner names = {};
+        arena    nodes = {};
+        ast_cons table = {};
+        token_buffer buf = {};
+        token_stream ts = {};
+
+        if (stream) {
+                fd = open(src_file, O_RDONLY);
+                if (fd < 0)
+                        return file_error(src_file);
+
+                int error = piped ? open_token_pipe  (&ts, fd, &names) :
+                                    open_token_stream(&ts, fd, &names);
+                if (error) {
+                        close(fd);
+                        return EXIT_FAILURE;
+                }
+        } else {
+                int error = mmap_in(&md, src_file);
+                if (error)
+                        return EXIT_FAILURE;
+
+                /* Identifiers point into the mapping, keep it until the end */
+                if (tokenize_compact(&buf, md.buf, &names, n_threads)) {
+                        mmap_free(&md);
+                        return EXIT_FAILURE;
+                }
 
-        token *toks = tokenize(md.buf, &names);
-        dump_tokens(toks);
+                dump_token_buffer(&buf);
+                open_token_buffer(&ts, &buf);
+        }
 
         clock_t end = clock();
-        fprintf(stderr, ascii(blue, "Tokens created: %lf sec\n"), (end - start) / CLOCKS_PER_SEC);
-        mmap_free(&md);
+        fprintf(stderr, ascii(blue, "Tokens created: %lf sec\n"), (double)(end - start) / CLOCKS_PER_SEC);
+
+        use_ast_arena(&nodes);
+        if (consed)
+                use_ast_cons(&table);
 
-$       (dump_tokens(toks);)
-$       (dump_array(&names, sizeof(char *), array_string);)
+        ast_node *tree = grammar_rule(&ts);
+        if (ts.failed)
+                tree = nullptr;
+
+        use_ast_cons(nullptr);
+        free_ast_cons(&table);
 
-        token *iter = toks;
-        ast_node *tree = grammar_rule(&iter);
         start = clock();
-        fprintf(stderr, ascii(blue, "Tree created:   %lf sec\n"), (start - end) / CLOCKS_PER_SEC);
+        fprintf(stderr, ascii(blue, "Tree created:   %lf sec\n"), (double)(start - end) / CLOCKS_PER_SEC);
 
-        if (!tree) {
-                free(toks);
-                char **data = (char **)names.data;
-                for (size_t i = 0; i < names.size; i++) {
-                        free(data[i]);
-                }
+        close_token_stream(&ts);
+        free_token_buffer(&buf);
+        if (stream)
+                close(fd);
 
-                free_array(&names, sizeof(char *));
+$       (dump_interner(&names);)
+
+        if (!tree) {
+                free_tree(&nodes);
+                free_interner(&names);
+                if (!stream)
+                        mmap_free(&md);
 
                 fprintf(stderr, ascii(red, "..................\n"
                                            "Compilation failed\n"));
@@ -68,28 +150,33 @@ $       (dump_array(&names, sizeof(char *), array_string);)
                 $(dump_tree(tree);)
         }
 
-        save_ast_tree(out, tree);
+        int error = 0;
+        if (text)
+                save_ast_tree(out, tree);
+        else
+                error = save_binary_tree(out, tree);
 
         end = clock();
-        fprintf(stderr, ascii(blue, "Tree saved:     %lf sec\n"), (end - start) / CLOCKS_PER_SEC);
-        free(toks);
+        fprintf(stderr, ascii(blue, "Tree saved:     %lf sec\n"), (double)(end - start) / CLOCKS_PER_SEC);
+        free_tree(&nodes);
+        free_interner(&names);
+        if (!stream)
+                mmap_free(&md);
+        fclose(out);
 
-        char **data = (char **)names.data;
-        for (size_t i = 0; i < names.size; i++) {
-                free(data[i]);
+        if (error) {
+                fprintf(stderr, ascii(red, "Can't save the tree\n"));
+                return EXIT_FAILURE;
         }
 
-        free_array(&names, sizeof(char *));
-        fclose(out);
-
         end = clock();
-        fprintf(stderr, ascii(green, "Abstract syntax tree compiled: %lf sec\n"), (end - init) / CLOCKS_PER_SEC);
+        fprintf(stderr, ascii(green, "Abstract syntax tree compiled: %lf sec\n"), (double)(end - init) / CLOCKS_PER_SEC);
         return EXIT_SUCCESS;
 }
 
 static int input_error()
 {
-        fprintf(stderr, ascii(red, "There must be 3 arguments\n"));
+        fprintf(stderr, ascii(red, "Usage: tr [-j threads] [-s | -p] [-t] [-c] source tree\n"));
         return EXIT_FAILURE;
 }
 
@@ -13,7 +13,7 @@
 
 #define require(__keyword)                 \
 do {                                       \
-        if (keyword(*toks) != __keyword) { \
+        if (keyword(peek_token(toks)) != __keyword) { \
                 return syntax_error(toks); \
         }                                  \
         move(toks);                        \
@@ -24,46 +24,44 @@ do {                                       \
 #define syntax_error(toks)                                               \
         fprintf(logs, html(red, bold("Syntax error in %s, line: %d\n")), \
                       __PRETTY_FUNCTION__, __LINE__),                    \
-        dump_tokens(*toks), nullptr
+        print_token(peek_token(toks)), nullptr
 
 #define core_error(toks)                                                 \
         fprintf(logs, html(red, bold("Core error in %s, line: %d\n")),   \
                       __PRETTY_FUNCTION__, __LINE__),                    \
-        dump_tokens(*toks), nullptr
+        print_token(peek_token(toks)), nullptr
 
 #else 
 
-static ast_node *syntax_error(token **toks);
-static ast_node *core_error  (token **toks);
-static void print_token(token *tok);
+static ast_node *syntax_error(token_stream *toks);
+static ast_node *core_error  (token_stream *toks);
 
 #endif /* ERROR_TRACE */
 
-static token *next(token **toks);
-static token *move(token **toks);
-
-static int       keyword(token *tok);
-static double    *number(token *tok);
-static const char *ident(token *tok);
-
-ast_node    *grammar_rule(token **toks);
-ast_node     *assign_rule(token **toks);
-ast_node     *define_rule(token **toks);
-ast_node      *block_rule(token **toks);
-ast_node  *statement_rule(token **toks);
-ast_node *expression_rule(token **toks);
-ast_node   *additive_rule(token **toks);
-ast_node     *factor_rule(token **toks);
-ast_node   *exponent_rule(token **toks);
-ast_node    *boolean_rule(token **toks);
-ast_node    *logical_rule(token **toks);
-
-ast_node         *if_rule(token **toks);
-ast_node      *while_rule(token **toks);
-ast_node      *array_rule(token **toks);
-ast_node      *ident_rule(token **toks);
-ast_node     *number_rule(token **toks);
-ast_node   *function_rule(token **toks);
+static void print_token(const token *tok);
+
+static const token *next(token_stream *toks);
+static const token *move(token_stream *toks);
+
+static int             keyword(const token *tok);
+static const double    *number(const token *tok);
+static const char       *ident(const token *tok);
+
+ast_node    *grammar_rule(token_stream *toks);
+ast_node     *assign_rule(token_stream *toks);
+ast_node     *define_rule(token_stream *toks);
+ast_node      *block_rule(token_stream *toks);
+ast_node  *statement_rule(token_stream *toks);
+ast_node *expression_rule(token_stream *toks);
+ast_node     *binary_rule(token_stream *toks, int min_prec);
+ast_node   *exponent_rule(token_stream *toks);
+
+ast_node         *if_rule(token_stream *toks);
+ast_node      *while_rule(token_stream *toks);
+ast_node      *array_rule(token_stream *toks);
+ast_node      *ident_rule(token_stream *toks);
+ast_node     *number_rule(token_stream *toks);
+ast_node   *function_rule(token_stream *toks);
 
 ast_node *create_ast(const char *str);
 
@@ -89,45 +87,44 @@ ast_node *create_ast(const char *source_code)
 {
         assert(source_code);
 
-        array names = {0};
+        interner names = {};
         token *toks = tokenize(source_code, &names);
         fprintf(logs, "\n\n%s\n\n", source_code);
 $       (dump_tokens(toks);)
-$       (dump_array(&names, sizeof(char *), array_string);)
+$       (dump_interner(&names);)
+
+        token_stream stream = {};
+        open_token_array(&stream, toks);
 
-        token *iter = toks;
+        arena nodes = {};
+        arena *prev = use_ast_arena(&nodes);
 
-        ast_node *tree = grammar_rule(&iter);
+        ast_node *tree = grammar_rule(&stream);
         fprintf(logs, "\n\n%s\n\n", source_code);
         $(dump_tree(tree);)
 
-        free_tree(tree);
+        use_ast_arena(prev);
+        free_tree(&nodes);
         free(toks);
-
-        char **data = (char **)names.data;
-        for (size_t i = 0; i < names.size; i++) {
-                free(data[i]);
-        }
-
-        free_array(&names, sizeof(char *));
+        free_interner(&names);
 
         return nullptr;
 }
 
-ast_node *grammar_rule(token **toks)
+ast_node *grammar_rule(token_stream *toks)
 {
         assert(toks);
 
         ast_node *root = nullptr;
 
-        while (keyword(*toks) == KW_DEFINE || 
-               keyword(*toks) == KW_ASSERT) { 
+        while (keyword(peek_token(toks)) == KW_DEFINE || 
+               keyword(peek_token(toks)) == KW_ASSERT) { 
 
                 ast_node *stmt = create_ast_keyword(AST_STMT);
                 if (!stmt)
                         return core_error(toks);
 
-                switch (keyword(*toks)) {
+                switch (keyword(peek_token(toks))) {
 
                 case KW_ASSERT:
                         require(KW_ASSERT);
@@ -156,14 +153,14 @@ ast_node *grammar_rule(token **toks)
                 root = stmt;
         }
 
-        if (keyword(*toks) != KW_STOP)
+        if (keyword(peek_token(toks)) != KW_STOP)
                 return syntax_error(toks);
 
         return root;
 }
 
 
-ast_node *assign_rule(token **toks)
+ast_node *assign_rule(token_stream *toks)
 {
         assert(toks);
 
@@ -172,7 +169,7 @@ ast_node *assign_rule(token **toks)
                 return core_error(toks);
 
         ast_node *constant = nullptr;
-        if (keyword(*toks) == KW_CONST) {
+        if (keyword(peek_token(toks)) == KW_CONST) {
                 require(KW_CONST);
                 constant = create_ast_keyword(AST_CONST);
                 if (!constant)
@@ -198,7 +195,7 @@ ast_node *assign_rule(token **toks)
         return root;
 }
 
-ast_node *define_rule(token **toks)
+ast_node *define_rule(token_stream *toks)
 {
         assert(toks);
 $$
@@ -226,7 +223,7 @@ $$
         require(KW_OPEN);
 $$
 
-        if (ident(*toks)) {
+        if (ident(peek_token(toks))) {
 $$
                 func->right = create_ast_keyword(AST_PARAM);
 $$
@@ -240,7 +237,7 @@ $$
                         return syntax_error(toks);
 
 $$
-                while (keyword(*toks) == KW_COMMA) {
+                while (keyword(peek_token(toks)) == KW_COMMA) {
 $$
                         require(KW_COMMA);
                         ast_node *param = create_ast_keyword(AST_PARAM);
@@ -270,12 +267,12 @@ $$
         return root;
 }
 
-ast_node *block_rule(token **toks)
+ast_node *block_rule(token_stream *toks)
 {
         assert(toks);
 
         ast_node *root = nullptr;
-        if (keyword(*toks) == KW_BEGIN) {
+        if (keyword(peek_token(toks)) == KW_BEGIN) {
                 move(toks);
 
                 do {
@@ -301,7 +298,7 @@ ast_node *block_rule(token **toks)
                         stmt->left = root;
                         root = stmt;
 
-                } while (keyword(*toks) != KW_END);
+                } while (keyword(peek_token(toks)) != KW_END);
 
                 move(toks);
 
@@ -319,7 +316,7 @@ ast_node *block_rule(token **toks)
         return root;
 }
 
-ast_node *if_rule(token **toks)
+ast_node *if_rule(token_stream *toks)
 {
         assert(toks);
 
@@ -347,7 +344,7 @@ ast_node *if_rule(token **toks)
         if (!decision->left) 
                 return syntax_error(toks);
 
-        if (keyword(*toks) == KW_ELSE) {
+        if (keyword(peek_token(toks)) == KW_ELSE) {
                 move(toks);
 
                 decision->right = block_rule(toks);
@@ -358,7 +355,7 @@ ast_node *if_rule(token **toks)
         return root;
 }
 
-ast_node *while_rule(token **toks)
+ast_node *while_rule(token_stream *toks)
 {
         assert(toks);
 
@@ -382,13 +379,13 @@ ast_node *while_rule(token **toks)
         return root;
 }
 
-ast_node *statement_rule(token **toks)
+ast_node *statement_rule(token_stream *toks)
 {
         assert(toks);
 
         ast_node *root = nullptr;
 
-        if (keyword(*toks) == KW_IF) {
+        if (keyword(peek_token(toks)) == KW_IF) {
                 root = if_rule(toks);
                 if (!root)
                         return syntax_error(toks);
@@ -396,7 +393,7 @@ ast_node *statement_rule(token **toks)
                 return root;
         }
 
-        if (keyword(*toks) == KW_WHILE) {
+        if (keyword(peek_token(toks)) == KW_WHILE) {
                 root = while_rule(toks);
                 if (!root)
                         return syntax_error(toks);
@@ -404,7 +401,7 @@ ast_node *statement_rule(token **toks)
                 return root;
         }
 
-        if (keyword(*toks) == KW_RETURN) {
+        if (keyword(peek_token(toks)) == KW_RETURN) {
                 require(KW_RETURN);
 
                 root = create_ast_keyword(AST_RETURN);
@@ -420,13 +417,13 @@ ast_node *statement_rule(token **toks)
         }
 
         int assert = false;
-        if (keyword(*toks) == KW_ASSERT) {
+        if (keyword(peek_token(toks)) == KW_ASSERT) {
                 assert = true;
                 require(KW_ASSERT);
                 require(KW_OPEN);
         }
 
-        if (keyword(*toks) == KW_RETURN) {
+        if (keyword(peek_token(toks)) == KW_RETURN) {
                 require(KW_RETURN);
 
                 root = create_ast_keyword(AST_RETURN);
@@ -437,7 +434,7 @@ ast_node *statement_rule(token **toks)
                 if (!root->right)
                         return syntax_error(toks);
 
-        } else if (keyword(*toks) == KW_OUT) {
+        } else if (keyword(peek_token(toks)) == KW_OUT) {
                 require(KW_OUT);
 
                 root = create_ast_keyword(AST_OUT);
@@ -450,7 +447,7 @@ ast_node *statement_rule(token **toks)
                         return syntax_error(toks);
                 require(KW_CLOSE);
 
-        } else if (keyword(*toks) == KW_SHOW) {
+        } else if (keyword(peek_token(toks)) == KW_SHOW) {
                 require(KW_SHOW);
 
                 root = create_ast_keyword(AST_SHOW);
@@ -472,7 +469,7 @@ ast_node *statement_rule(token **toks)
                 require(KW_CLOSE);
 
         } else {
-                if (ident(*toks) && keyword(next(toks)) == KW_OPEN) {
+                if (ident(peek_token(toks)) && keyword(next(toks)) == KW_OPEN) {
                         root = function_rule(toks);
                         if (!root)
                                 return syntax_error(toks);
@@ -508,252 +505,167 @@ ast_node *statement_rule(token **toks)
 }
 
 
-ast_node *boolean_rule(token **toks)
+/*
+ * Binary operators by precedence, the lowest first.
+ * Levels that don't chain take one operator at most,
+ * "a < b < c" and "a ^ b ^ c" are syntax errors.
+ */
+enum binary_prec {
+        PREC_NONE    = 0,
+        PREC_LOGICAL = 1,
+        PREC_COMPARE = 2,
+        PREC_SUM     = 3,
+        PREC_PRODUCT = 4,
+        PREC_POWER   = 5,
+};
+
+struct binary_op {
+        int ast     = 0;
+        int prec    = PREC_NONE;
+        bool chains = false;
+};
+
+/* Operator keywords are ASCII characters */
+static const size_t N_BINARY_OPS = 128;
+
+struct binary_table {
+        binary_op ops[N_BINARY_OPS] = {};
+};
+
+static constexpr binary_table make_binary_table()
 {
-        assert(toks);
-
-        ast_node *root = nullptr;
-
-        root = additive_rule(toks);
-        if (!root) 
-                return syntax_error(toks);
-
-        while (keyword(*toks) == KW_ADD ||
-               keyword(*toks) == KW_SUB) {
-
-                ast_node *op = create_ast_node(AST_NODE_KEYWORD);
-                if (!root) 
-                        return core_error(toks);
-
-                switch (keyword(*toks)) {
-                case KW_ADD: 
-                        set_ast_keyword(op, AST_ADD); 
-                        break;
-                case KW_SUB: 
-                        set_ast_keyword(op, AST_SUB); 
-                        break;
-                default: 
-                        assert(0); 
-                        return syntax_error(toks);
-                }
-
-                move(toks);
-
-                op->right = additive_rule(toks);
-                if (!op->right) 
-                        return core_error(toks);
-
-                op->left = root;
-                root = op;
+        binary_table table = {};
+
+        struct { int keyword; int ast; int prec; bool chains; } ops[] = {
+                { KW_OR,     AST_OR,     PREC_LOGICAL, true  },
+                { KW_AND,    AST_AND,    PREC_LOGICAL, true  },
+                { KW_LOW,    AST_LOW,    PREC_COMPARE, false },
+                { KW_EQUAL,  AST_EQUAL,  PREC_COMPARE, false },
+                { KW_GREAT,  AST_GREAT,  PREC_COMPARE, false },
+                { KW_NEQUAL, AST_NEQUAL, PREC_COMPARE, false },
+                { KW_GEQUAL, AST_GEQUAL, PREC_COMPARE, false },
+                { KW_LEQUAL, AST_LEQUAL, PREC_COMPARE, false },
+                { KW_ADD,    AST_ADD,    PREC_SUM,     true  },
+                { KW_SUB,    AST_SUB,    PREC_SUM,     true  },
+                { KW_MUL,    AST_MUL,    PREC_PRODUCT, true  },
+                { KW_DIV,    AST_DIV,    PREC_PRODUCT, true  },
+                { KW_POW,    AST_POW,    PREC_POWER,   false },
+        };
+
+        for (const auto &op : ops) {
+                binary_op &entry = table.ops[op.keyword];
+                entry.ast    = op.ast;
+                entry.prec   = op.prec;
+                entry.chains = op.chains;
         }
 
-        return root;
+        return table;
 }
 
-ast_node *logical_rule(token **toks)
-{ 
-        assert(toks);
+static constexpr binary_table BINARY_OPS = make_binary_table();
 
-        ast_node *root = create_ast_node(AST_NODE_KEYWORD);
-        if (!root) 
-                return core_error(toks);
-
-        root->left = boolean_rule(toks); 
-        if (!root->left) 
-                return syntax_error(toks);
-
-        switch (keyword(*toks)) {
-                case KW_LOW:    
-                        set_ast_keyword(root, AST_LOW);    
-                        break;
-                case KW_EQUAL:  
-                        set_ast_keyword(root, AST_EQUAL);  
-                        break;
-                case KW_GREAT:  
-                        set_ast_keyword(root, AST_GREAT);  
-                        break;
-                case KW_NEQUAL: 
-                        set_ast_keyword(root, AST_NEQUAL); 
-                        break;
-                case KW_GEQUAL: 
-                        set_ast_keyword(root, AST_GEQUAL); 
-                        break;
-                case KW_LEQUAL: 
-                        set_ast_keyword(root, AST_LEQUAL); 
-                        break;
-                default: 
-                        return root->left;
-        }
-
-        move(toks);
-
-        root->right = boolean_rule(toks); 
-        if (!root->right) 
-                return syntax_error(toks);
+static inline const binary_op *find_binary_op(const token *tok)
+{
+        int kw = keyword(tok);
+        if (kw <= 0 || (size_t)kw >= N_BINARY_OPS)
+                return nullptr;
 
-        return root;
+        const binary_op *op = &BINARY_OPS.ops[kw];
+        return op->prec ? op : nullptr;
 }
 
-ast_node *expression_rule(token **toks)
-{ 
+/*
+ * Expressions are immutable once parsed. Their nodes are built
+ * after the operands with cons_ast_*(), so that repeated
+ * subexpressions are shared when a cons table is in use.
+ */
+ast_node *expression_rule(token_stream *toks)
+{
         assert(toks);
-
-        ast_node *root = logical_rule(toks);
-        if (!root) 
-                return syntax_error(toks);
-
-        while (keyword(*toks) == KW_OR ||
-               keyword(*toks) == KW_AND) {
-
-                ast_node *op = create_ast_node(AST_NODE_KEYWORD);
-                if (!root) 
-                        return core_error(toks);
-
-                switch (keyword(*toks)) {
-                case KW_OR: 
-                        set_ast_keyword(op, AST_OR); 
-                        break;
-                case KW_AND: 
-                        set_ast_keyword(op, AST_AND); 
-                        break;
-                default: 
-                        assert(0); 
-                        break;
-                }
-
-                move(toks);
-
-                op->right = logical_rule(toks);
-                if (!op->right) 
-                        return core_error(toks);
-
-                op->left = root;
-                root = op;
-        }
-
-        return root;
+        return binary_rule(toks, PREC_LOGICAL);
 }
 
-ast_node *additive_rule(token **toks)
-{ 
+/*
+ * Precedence climbing: operators of 'min_prec' and above
+ * are folded into the tree, from left to right. Costs one call
+ * per operator, not per precedence level.
+ */
+ast_node *binary_rule(token_stream *toks, int min_prec)
+{
         assert(toks);
 
-        ast_node *root = factor_rule(toks);
-        if (!root) 
+        ast_node *root = exponent_rule(toks);
+        if (!root)
                 return syntax_error(toks);
 
-        while (keyword(*toks) == KW_MUL ||
-               keyword(*toks) == KW_DIV) {
+        int max_prec = PREC_POWER;
 
-                ast_node *op = create_ast_node(AST_NODE_KEYWORD);
-                if (!op) 
-                        return core_error(toks);
-
-                switch (keyword(*toks)) {
-                case KW_MUL: 
-                        set_ast_keyword(op, AST_MUL); 
-                        break;
-                case KW_DIV: 
-                        set_ast_keyword(op, AST_DIV); 
-                        break;
-                default: 
-                        assert(0); 
-                        break;
-                }
+        const binary_op *op = nullptr;
+        while ((op = find_binary_op(peek_token(toks))) &&
+               op->prec >= min_prec && op->prec <= max_prec) {
 
                 move(toks);
 
-                op->right = factor_rule(toks);
-                if (!op->right) 
-                        return core_error(toks);
-
-                op->left = root;
-                root = op;
-        }
-
-        return root;
-}
-
-ast_node *factor_rule(token **toks)
-{ 
-        assert(toks);
-
-        ast_node *root = exponent_rule(toks);
-        if (!root) 
-                return syntax_error(toks);
-
-        if (keyword(*toks) == KW_POW) {
-
-                require(KW_POW);
+                ast_node *right = binary_rule(toks, op->prec + 1);
+                if (!right)
+                        return syntax_error(toks);
 
-                ast_node *op = create_ast_keyword(AST_POW);
-                if (!op) 
+                root = cons_ast_keyword(op->ast, root, right);
+                if (!root)
                         return core_error(toks);
 
-                op->right = exponent_rule(toks);
-                if (!op->right) 
-                        return syntax_error(toks);
-
-                op->left = root;
-                root = op;
+                max_prec = op->chains ? op->prec : op->prec - 1;
         }
 
         return root;
 }
 
 
-ast_node *function_rule(token **toks) 
+ast_node *function_rule(token_stream *toks) 
 {
         assert(toks);
 
-        ast_node *root = create_ast_keyword(AST_CALL);
-        if (!root) 
-                return core_error(toks);
-
-        root->left = ident_rule(toks);
-        if (!root->left) 
-                return syntax_error(toks);
-
-        require(KW_OPEN);
-
-        if (keyword(*toks) == KW_CLOSE) {
-                require(KW_CLOSE);
-                return root;
-        }
+        if (!ident(peek_token(toks)))
+                return syntax_error(toks); 
 
-        root->right = create_ast_keyword(AST_PARAM);
-        if (!root->right)
+        ast_node *name = cons_ast_ident(ident(peek_token(toks)), nullptr);
+        if (!name) 
                 return core_error(toks);
 
-        root->right->right = expression_rule(toks);
-        if (!root->right->right)
-                return syntax_error(toks);
+        move(toks);
+        require(KW_OPEN);
 
-        while (keyword(*toks) == KW_COMMA) {
-                require(KW_COMMA);
+        ast_node *params = nullptr;
+        if (keyword(peek_token(toks)) != KW_CLOSE) {
+                do {
+                        if (params)
+                                require(KW_COMMA);
 
-                ast_node *param = create_ast_keyword(AST_PARAM);
-                if (!param)
-                        return core_error(toks);
+                        ast_node *param = expression_rule(toks);
+                        if (!param) 
+                                return syntax_error(toks);
 
-                param->right = expression_rule(toks);
-                if (!param->right) 
-                        return syntax_error(toks);
+                        params = cons_ast_keyword(AST_PARAM, params, param);
+                        if (!params)
+                                return core_error(toks);
 
-                param->left = root->right;
-                root->right = param;
+                } while (keyword(peek_token(toks)) == KW_COMMA);
         }
 
         require(KW_CLOSE);
 
+        ast_node *root = cons_ast_keyword(AST_CALL, name, params);
+        if (!root) 
+                return core_error(toks);
+
         return root;
 }
 
-ast_node *array_rule(token **toks)
+ast_node *array_rule(token_stream *toks)
 {
         assert(toks);
 
-        if (!ident(*toks))
+        if (!ident(peek_token(toks)))
                 return syntax_error(toks);
 
         ast_node *root = ident_rule(toks);
@@ -771,13 +683,13 @@ ast_node *array_rule(token **toks)
         return root;
 }
 
-ast_node *exponent_rule(token **toks) 
+ast_node *exponent_rule(token_stream *toks) 
 {
         assert(toks);
 
         ast_node *root = nullptr;
 
-        if (ident(*toks)) {
+        if (ident(peek_token(toks))) {
 
                 if (keyword(next(toks)) == KW_OPEN) {
                         root = function_rule(toks);
@@ -787,28 +699,34 @@ ast_node *exponent_rule(token **toks)
                         return root;
                 }
 
-                if (keyword(next(toks)) == KW_QOPEN) {
-                        root = array_rule(toks);
-                        if (!root)
+                const char *name = ident(peek_token(toks));
+                move(toks);
+
+                ast_node *index = nullptr;
+                if (keyword(peek_token(toks)) == KW_QOPEN) {
+                        require(KW_QOPEN);
+
+                        index = expression_rule(toks);
+                        if (!index)
                                 return syntax_error(toks);
 
-                        return root;
+                        require(KW_QCLOSE);
                 }
 
-                root = ident_rule(toks);
+                root = cons_ast_ident(name, index);
                 if (!root) 
-                        return syntax_error(toks);
+                        return core_error(toks);
 
                 return root;
 
-        } else if (number(*toks)) {
+        } else if (number(peek_token(toks))) {
 
                 root = number_rule(toks);
                 if (!root) 
                         return syntax_error(toks);
 
                 return root;
-        } else if (keyword(*toks) == KW_OPEN) {
+        } else if (keyword(peek_token(toks)) == KW_OPEN) {
 
                 require(KW_OPEN);
 
@@ -820,52 +738,63 @@ ast_node *exponent_rule(token **toks)
                 return root;
         }
 
-        root = create_ast_node(AST_NODE_KEYWORD);
-        if (!root)
-                return core_error(toks);
+        int op = 0;
+        ast_node *left = nullptr;
 
-        switch (keyword(*toks)) {
+        switch (keyword(peek_token(toks))) {
         case KW_NOT:
-                set_ast_keyword(root, AST_NOT);
                 move(toks);
-                root->right = exponent_rule(toks);
-                if (!root->right)
+                root = exponent_rule(toks);
+                if (!root)
                         return syntax_error(toks);
 
+                root = cons_ast_keyword(AST_NOT, nullptr, root);
+                if (!root)
+                        return core_error(toks);
+
                 return root;
         case KW_ADD:
                 move(toks);
-                /* free root */
                 root = exponent_rule(toks);
                 if (!root)
                         return syntax_error(toks);
                 return root;
         case KW_SUB:
-                set_ast_keyword(root, AST_SUB);
                 move(toks);
-                root->left = create_ast_number(0);
-                root->right = exponent_rule(toks);
-                if (!root->right)
+                left = cons_ast_number(0);
+                if (!left)
+                        return core_error(toks);
+
+                root = exponent_rule(toks);
+                if (!root)
                         return syntax_error(toks);
 
+                root = cons_ast_keyword(AST_SUB, left, root);
+                if (!root)
+                        return core_error(toks);
+
                 return root;
         case KW_SIN:
                 move(toks);
-                set_ast_keyword(root, AST_SIN);
+                op = AST_SIN;
                 break;
         case KW_COS:
                 move(toks);
-                set_ast_keyword(root, AST_COS);
+                op = AST_COS;
                 break;
         case KW_INT:
                 move(toks);
-                set_ast_keyword(root, AST_INT);
+                op = AST_INT;
                 break;
         case KW_IN:
-                set_ast_keyword(root, AST_IN);
                 move(toks);
                 require(KW_OPEN);
                 require(KW_CLOSE);
+
+                root = cons_ast_keyword(AST_IN, nullptr, nullptr);
+                if (!root)
+                        return core_error(toks);
+
                 return root;
         default:
                 break;
@@ -873,22 +802,26 @@ ast_node *exponent_rule(token **toks)
 
         require(KW_OPEN);
 
-        root->right = expression_rule(toks);
-        if (!root->right) 
+        root = expression_rule(toks);
+        if (!root) 
                 return syntax_error(toks);
 
         require(KW_CLOSE);
 
+        root = cons_ast_keyword(op, nullptr, root);
+        if (!root)
+                return core_error(toks);
+
         return root;
 }
 
-ast_node *number_rule(token **toks)
+ast_node *number_rule(token_stream *toks)
 { 
         assert(toks);
-        if (!number(*toks))
+        if (!number(peek_token(toks)))
                 return syntax_error(toks); 
 
-        ast_node *root = create_ast_number(*number(*toks));
+        ast_node *root = cons_ast_number(*number(peek_token(toks)));
         if (!root) 
                 return core_error(toks);
 
@@ -897,13 +830,13 @@ ast_node *number_rule(token **toks)
         return root;
 }
 
-ast_node *ident_rule(token **toks)
+ast_node *ident_rule(token_stream *toks)
 {
         assert(toks);
-        if (!ident(*toks))
+        if (!ident(peek_token(toks)))
                 return syntax_error(toks); 
 
-        ast_node *root = create_ast_ident(ident(*toks));
+        ast_node *root = create_ast_ident(ident(peek_token(toks)));
         if (!root) 
                 return core_error(toks);
 
@@ -913,40 +846,43 @@ ast_node *ident_rule(token **toks)
 }
 
 #ifndef ERROR_TRACE
-static ast_node *syntax_error(token **toks)
+static ast_node *syntax_error(token_stream *toks)
 {
         assert(toks);
 
+        size_t line   = 0;
+        size_t column = 0;
+        if (!stream_location(toks, &line, &column))
+                fprintf(stderr, "%lu:%lu: ", line, column);
+
         fprintf(stderr, ascii(red, "Syntax error -- "));
-        print_token(*toks);
-        //dump_tokens(*toks)
+        print_token(peek_token(toks));
         return nullptr;
 }
 
-static ast_node *core_error(token **toks)
+static ast_node *core_error(token_stream *toks)
 {
         assert(toks);
 
         fprintf(stderr, ascii(red, "Core error -- "));
-        print_token(*toks);
+        print_token(peek_token(toks));
         return nullptr;
 }
 #endif
 
-static token *next(token **toks) 
+static const token *next(token_stream *toks) 
 {
         assert(toks);
-        return (*toks) + 1;
+        return peek_token(toks, 1);
 }
 
-static token *move(token **toks)
+static const token *move(token_stream *toks)
 {
         assert(toks);
-        (*toks)++;
-        return (*toks);
+        return next_token(toks);
 }
 
-static int keyword(token *tok)
+static int keyword(const token *tok)
 {
         assert(tok);
 
@@ -956,7 +892,7 @@ static int keyword(token *tok)
         return 0;
 }
 
-static double *number(token *tok)
+static const double *number(const token *tok)
 {
         assert(tok);
 
@@ -966,7 +902,7 @@ static double *number(token *tok)
         return nullptr;
 }
 
-static const char *ident(token *tok)
+static const char *ident(const token *tok)
 {
         assert(tok);
 
@@ -976,7 +912,7 @@ static const char *ident(token *tok)
         return nullptr;
 }
 
-static void print_token(token *toks) 
+static void print_token(const token *toks) 
 {
         assert(toks);
 
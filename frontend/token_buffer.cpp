@@ -0,0 +1,345 @@
+#include <stdio.h>
+#include <assert.h>
+#include <string.h>
+#include <stdlib.h>
+#include <logs.h>
+#include <array.h>
+#include <interner.h>
+
+#include <frontend/token.h>
+#include <frontend/keyword.h>
+
+static const size_t INIT_CAPACITY = 1024;
+
+struct location_checkpoint {
+        size_t offset = 0;
+        /* Position in 'deltas' right after this token's delta */
+        size_t delta  = 0;
+};
+
+static const int KIND_KEYWORDS[] = {
+#define   LINKABLE(xxx) xxx
+#define UNLINKABLE(xxx) xxx
+#define KEYWORD(name, keyword, ident) KW_##name,
+
+#include "../KEYWORDS"
+
+#undef KEYWORD
+#undef LINKABLE
+#undef UNLINKABLE
+};
+
+static_assert(sizeof(KIND_KEYWORDS) / sizeof(int) == KIND_IDENT, "Keyword kinds mismatch");
+static_assert(KIND_NUMBER <= UINT8_MAX, "Token kinds don't fit into a byte");
+
+static uint8_t keyword_kind(int keyword)
+{
+        switch (keyword) {
+#define   LINKABLE(xxx) xxx
+#define UNLINKABLE(xxx) xxx
+#define KEYWORD(name, keyword, ident) case KW_##name: return KIND_##name;
+
+#include "../KEYWORDS"
+
+#undef KEYWORD
+#undef LINKABLE
+#undef UNLINKABLE
+        default:
+                assert(0);
+                return KIND_NULL;
+        }
+}
+
+static int expand_buffer(token_buffer *const buf)
+{
+        assert(buf);
+
+        size_t capacity = buf->capacity ? buf->capacity * 2 : INIT_CAPACITY;
+
+        uint8_t *kinds = (uint8_t *)realloc(buf->kinds, capacity * sizeof(uint8_t));
+        if (!kinds)
+                return 1;
+
+        buf->kinds = kinds;
+
+        uint32_t *payloads = (uint32_t *)realloc(buf->payloads, capacity * sizeof(uint32_t));
+        if (!payloads)
+                return 1;
+
+        buf->payloads = payloads;
+        buf->capacity = capacity;
+
+        return 0;
+}
+
+static int push_varint(array *const bytes, size_t value)
+{
+        assert(bytes);
+
+        do {
+                uint8_t byte = value & 0x7F;
+                value >>= 7;
+                if (value)
+                        byte |= 0x80;
+
+                if (!array_push(bytes, &byte, sizeof(uint8_t)))
+                        return 1;
+        } while (value);
+
+        return 0;
+}
+
+static size_t read_varint(const uint8_t *bytes, size_t *pos)
+{
+        assert(bytes);
+        assert(pos);
+
+        size_t value = 0;
+        for (unsigned shift = 0; ; shift += 7) {
+                uint8_t byte = bytes[(*pos)++];
+                value |= (size_t)(byte & 0x7F) << shift;
+                if (!(byte & 0x80))
+                        return value;
+        }
+}
+
+static int push_location(token_buffer *const buf, size_t offset)
+{
+        assert(buf);
+        assert(offset >= buf->last_offset);
+
+        if (push_varint(&buf->deltas, offset - buf->last_offset))
+                return 1;
+
+        buf->last_offset = offset;
+
+        if (buf->size % LOCATION_STEP == 0) {
+                location_checkpoint cp = {};
+                cp.offset = offset;
+                cp.delta  = buf->deltas.size;
+
+                if (!array_push(&buf->checkpoints, &cp, sizeof(location_checkpoint)))
+                        return 1;
+        }
+
+        return 0;
+}
+
+int append_tokens(token_buffer *const buf, const token *toks,
+                  const size_t *offsets, size_t n_toks)
+{
+        assert(buf);
+        assert(buf->idents);
+        assert(toks || !n_toks);
+        assert(offsets || !n_toks);
+
+        for (size_t i = 0; i < n_toks; i++) {
+                if (buf->size == buf->capacity && expand_buffer(buf))
+                        return 1;
+
+                uint8_t  kind    = 0;
+                uint32_t payload = 0;
+                double   number  = 0;
+
+                switch (toks[i].type) {
+                case TOKEN_KEYWORD:
+                        kind = keyword_kind(toks[i].data.keyword);
+                        break;
+                case TOKEN_IDENT:
+                        kind = KIND_IDENT;
+                        if (!intern(buf->idents, toks[i].data.ident, toks[i].length, &payload))
+                                return 1;
+                        break;
+                case TOKEN_NUMBER:
+                        kind = KIND_NUMBER;
+                        payload = (uint32_t)buf->constants.size;
+                        number  = toks[i].data.number;
+                        if (!array_push(&buf->constants, &number, sizeof(double)))
+                                return 1;
+                        break;
+                default:
+                        assert(0);
+                        return 1;
+                }
+
+                if (push_location(buf, offsets[i]))
+                        return 1;
+
+                buf->kinds   [buf->size] = kind;
+                buf->payloads[buf->size] = payload;
+                buf->size++;
+        }
+
+        return 0;
+}
+
+int append_lines(token_buffer *const buf, const char *str, size_t end)
+{
+        assert(buf);
+        assert(str);
+
+        if (!buf->lines.size) {
+                size_t first = 0;
+                if (!array_push(&buf->lines, &first, sizeof(size_t)))
+                        return 1;
+        }
+
+        while (buf->scanned < end) {
+                const char *newline = (const char *)memchr(str + buf->scanned, '\n',
+                                                           end - buf->scanned);
+                if (!newline) {
+                        buf->scanned = end;
+                        break;
+                }
+
+                size_t start = (size_t)(newline - str) + 1;
+                if (!array_push(&buf->lines, &start, sizeof(size_t)))
+                        return 1;
+
+                buf->scanned = start;
+        }
+
+        return 0;
+}
+
+token decode_token(const token_buffer *const buf, size_t index)
+{
+        assert(buf);
+        assert(index < buf->size);
+
+        token tok = {};
+
+        uint8_t kind = buf->kinds[index];
+        switch (kind) {
+        case KIND_IDENT:
+                tok.type       = TOKEN_IDENT;
+                tok.data.ident = interned(buf->idents, buf->payloads[index]);
+                break;
+        case KIND_NUMBER:
+                tok.type        = TOKEN_NUMBER;
+                tok.data.number = ((double *)buf->constants.data)[buf->payloads[index]];
+                break;
+        default:
+                tok.type         = TOKEN_KEYWORD;
+                tok.data.keyword = KIND_KEYWORDS[kind];
+                break;
+        }
+
+        return tok;
+}
+
+static size_t token_offset(const token_buffer *const buf, size_t index)
+{
+        assert(buf);
+        assert(index < buf->size);
+
+        const location_checkpoint *cp =
+                (const location_checkpoint *)buf->checkpoints.data + index / LOCATION_STEP;
+
+        size_t offset = cp->offset;
+        size_t pos    = cp->delta;
+        for (size_t i = 0; i < index % LOCATION_STEP; i++)
+                offset += read_varint((const uint8_t *)buf->deltas.data, &pos);
+
+        return offset;
+}
+
+int token_location(const token_buffer *const buf, size_t index,
+                   size_t *line, size_t *column)
+{
+        assert(buf);
+        assert(line);
+        assert(column);
+
+        if (index >= buf->size || !buf->lines.size)
+                return 1;
+
+        size_t offset = token_offset(buf, index);
+
+        /* The last line start not greater than the offset */
+        const size_t *lines = (const size_t *)buf->lines.data;
+        size_t low  = 0;
+        size_t high = buf->lines.size;
+        while (high - low > 1) {
+                size_t middle = low + (high - low) / 2;
+                if (lines[middle] <= offset)
+                        low = middle;
+                else
+                        high = middle;
+        }
+
+        *line   = low + 1;
+        *column = offset - lines[low] + 1;
+
+        return 0;
+}
+
+void free_token_buffer(token_buffer *const buf)
+{
+        assert(buf);
+
+        if (buf->kinds) {
+                free(buf->kinds);
+        }
+
+        if (buf->payloads) {
+                free(buf->payloads);
+        }
+
+        free_array(&buf->constants,   sizeof(double));
+        free_array(&buf->deltas,      sizeof(uint8_t));
+        free_array(&buf->checkpoints, sizeof(location_checkpoint));
+        free_array(&buf->lines,       sizeof(size_t));
+
+        *buf = {};
+}
+
+void dump_token_buffer(const token_buffer *const buf)
+{
+        assert(buf);
+
+        size_t hot  = buf->size * (sizeof(uint8_t) + sizeof(uint32_t));
+        size_t cold = buf->deltas.size +
+                      buf->checkpoints.size * sizeof(location_checkpoint) +
+                      buf->lines.size * sizeof(size_t);
+
+        fprintf(logs, "Token buffer dump:\n\n");
+        fprintf(logs, "%s", "================================================\n"
+                            "| <b>Kinds</b>                                         |\n"
+                            "================================================\n");
+
+        /* Offsets are decoded sequentially, lines are walked along */
+        const size_t *lines = (const size_t *)buf->lines.data;
+        size_t line   = 0;
+        size_t offset = 0;
+        size_t pos    = 0;
+
+        for (size_t i = 0; i < buf->size; i++) {
+                offset += read_varint((const uint8_t *)buf->deltas.data, &pos);
+                while (line + 1 < buf->lines.size && lines[line + 1] <= offset)
+                        line++;
+
+                fprintf(logs, "+----+----+---------+--------------------------\n"
+                              "|%-3lu |%3lu:%-3lu| ", i, line + 1,
+                              buf->lines.size ? offset - lines[line] + 1 : 0);
+
+                token tok = decode_token(buf, i);
+                if (tok.type == TOKEN_KEYWORD) {
+                        fprintf(logs, html(blue, "keyword") " | %s\n",
+                                        keyword_string(tok.data.keyword));
+                } else if (tok.type == TOKEN_NUMBER) {
+                        fprintf(logs, html(#ca6f1e, "number") "  | %lg [%u]\n",
+                                        tok.data.number, buf->payloads[i]);
+                } else {
+                        fprintf(logs, html(green, "ident") "   | %s [%u]\n",
+                                        tok.data.ident, buf->payloads[i]);
+                }
+        }
+
+        fprintf(logs, "================================================\n"
+                      "| Total: %lu tokens, %lu constants                \n"
+                      "| Hot:  %lu bytes                                 \n"
+                      "| Cold: %lu bytes                                 \n"
+                      "================================================\n\n\n",
+                      buf->size, buf->constants.size, hot, cold);
+}
@@ -0,0 +1,27 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+#include <array.h>
+
+/*
+ * Bump pointer allocator.
+ *
+ * Memory is taken from large slabs and is never freed
+ * piece by piece. free_arena() releases everything at once.
+ * Zero initialized arena is ready to use.
+ */
+struct arena {
+        array slabs = {};
+
+        char  *top  = nullptr;
+        size_t left = 0;
+};
+
+void *arena_alloc(arena *const mem, size_t size,
+                  size_t align = alignof(max_align_t));
+
+void free_arena(arena *const mem);
+
+
+#endif /* ARENA_H */
@@ -17,6 +17,13 @@ void array_pop     (array *const arr, size_t item_size);
 void *array_create (array *const arr, size_t item_size);
 void *array_extract(array *const arr, size_t item_size);
 
+/*
+ * Pushes 'n_items' (at least one) items at once.
+ * Returns the first of them.
+ */
+void *array_append(array *const arr, const void *items, size_t n_items,
+                   size_t item_size);
+
 void *array_top(array *const arr, size_t item_size);
 
 void free_array(array *const arr, size_t item_size);
@@ -0,0 +1,77 @@
+#ifndef BINARY_H
+#define BINARY_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <interner.h>
+
+#include <ast/tree.h>
+#include <ast/flat.h>
+
+/*
+ * Binary abstract syntax tree.
+ *
+ * Layout, native byte order:
+ *
+ *      header
+ *      string table    'n_strings' null-terminated names,
+ *                      padded with zeros to 'strings_size'
+ *      constant pool   'n_constants' doubles
+ *      node stream     'n_nodes' flat nodes in preorder
+ *
+ * Identifier nodes keep the index of their name in the string
+ * table, number nodes the index of their constant. Each name
+ * is stored once. Numbers are stored bit-exactly.
+ *
+ * The text tree of save_ast_tree() is kept for debugging.
+ */
+static const char     AST_BINARY_MAGIC[4] = { 'A', 'S', 'T', 'B' };
+static const uint32_t AST_BINARY_VERSION  = 1;
+
+struct ast_binary_header {
+        char magic[4]     = {};
+        uint32_t version  = 0;
+
+        uint32_t n_strings    = 0;
+        uint32_t strings_size = 0;
+        uint32_t n_constants  = 0;
+        uint32_t n_nodes      = 0;
+};
+
+/*
+ * Writes the subtree of 'root'. Returns 0 on success.
+ */
+int save_binary_tree(FILE *file, ast_node *const root);
+int save_flat_binary(FILE *file, const flat_tree *const flat);
+
+/*
+ * Checks if 'buf' starts with the binary tree header.
+ */
+bool is_binary_tree(const char *buf, size_t size);
+
+/*
+ * Reads binary tree of 'size' bytes into an empty flat tree.
+ * Names are interned into 'idents'. Returns 0 on success.
+ */
+int read_binary_tree(const char *buf, size_t size,
+                     interner *const idents, flat_tree *const flat);
+
+/*
+ * Same as read_binary_tree(), but nodes and constants are not
+ * copied: the tree views them in 'buf', which must be aligned
+ * to 8 bytes and outlive the tree. Only names are interned.
+ * Nodes are still checked, in one sequential pass.
+ */
+int map_binary_tree(char *buf, size_t size,
+                    interner *const idents, flat_tree *const flat);
+
+/*
+ * Maps binary tree or reads text tree, whichever 'buf' holds.
+ * Text tree must be null-terminated. Keep 'buf' until
+ * the tree is freed.
+ */
+int load_flat_tree(char *buf, size_t size,
+                   interner *const idents, flat_tree *const flat);
+
+
+#endif /* BINARY_H */
@@ -0,0 +1,118 @@
+#ifndef FLAT_H
+#define FLAT_H
+
+#include <stdio.h>
+#include <assert.h>
+#include <stdint.h>
+#include <array.h>
+#include <interner.h>
+
+#include <ast/tree.h>
+
+/*
+ * Flat abstract syntax tree.
+ *
+ * Nodes are stored contiguously in preorder, 16 bytes each.
+ * Children are 32-bit indices into 'nodes'. The root is
+ * always the first node, so it can't be a child and
+ * index 0 means there is no child.
+ *
+ * Numbers live in the 'constants' pool and identifiers
+ * in the 'names' pool, nodes keep their index. Keywords
+ * are stored in place.
+ *
+ * A mapped tree views 'nodes' and 'constants' in a mapped
+ * binary tree (see map_binary_tree()), they can't be modified
+ * and are not freed. The image must outlive the tree.
+ */
+struct flat_node {
+        uint32_t left  = 0;
+        uint32_t right = 0;
+        uint32_t type  = 0;
+        uint32_t data  = 0;
+};
+
+struct flat_tree {
+        array nodes     = {};
+        array constants = {};
+        array names     = {};
+
+        bool mapped = false;
+};
+
+/*
+ * Appends 'root' to an empty flat tree. Returns 0 on success.
+ */
+int flatten_tree(flat_tree *const flat, const ast_node *root);
+void free_flat_tree(flat_tree *const flat);
+
+/*
+ * read_ast_tree() straight into an empty flat tree,
+ * no pointer nodes are created. Returns 0 on success.
+ */
+int read_flat_tree(char **str, interner *const idents, flat_tree *const flat);
+
+/*
+ * Building blocks for preorder writers: a node is reserved
+ * before its children are appended and set after that.
+ * 'value' gives the type and the data. Return 0 on success.
+ */
+int reserve_flat_node(flat_tree *const flat, uint32_t *index);
+int set_flat_node(flat_tree *const flat, uint32_t index, const ast_node *value,
+                  uint32_t left, uint32_t right);
+
+/*
+ * Same text as save_ast_tree() for the subtree of 'node'.
+ */
+void save_flat_tree(FILE *file, const flat_tree *const flat,
+                    const flat_node *node);
+
+static inline const flat_node *flat_root(const flat_tree *const flat)
+{
+        assert(flat);
+        return flat->nodes.size ? (const flat_node *)flat->nodes.data : nullptr;
+}
+
+static inline const flat_node *flat_left(const flat_tree *const flat,
+                                         const flat_node *node)
+{
+        assert(flat);
+        assert(node);
+        return node->left ? (const flat_node *)flat->nodes.data + node->left : nullptr;
+}
+
+static inline const flat_node *flat_right(const flat_tree *const flat,
+                                          const flat_node *node)
+{
+        assert(flat);
+        assert(node);
+        return node->right ? (const flat_node *)flat->nodes.data + node->right : nullptr;
+}
+
+static inline int flat_keyword(const flat_node *node)
+{
+        assert(node);
+        assert(node->type == AST_NODE_KEYWORD);
+        return (int)node->data;
+}
+
+static inline const double *flat_number(const flat_tree *const flat,
+                                        const flat_node *node)
+{
+        assert(flat);
+        assert(node);
+        assert(node->type == AST_NODE_NUMBER);
+        return (const double *)flat->constants.data + node->data;
+}
+
+static inline const char *flat_ident(const flat_tree *const flat,
+                                     const flat_node *node)
+{
+        assert(flat);
+        assert(node);
+        assert(node->type == AST_NODE_IDENT);
+        return ((const char *const *)flat->names.data)[node->data];
+}
+
+
+#endif /* FLAT_H */
@@ -3,6 +3,8 @@
 
 #include <stdint.h>
 #include <array.h>
+#include <arena.h>
+#include <interner.h>
 
 enum ast_node_type {
         AST_NODE_KEYWORD  = 0x01,
@@ -10,6 +12,12 @@ enum ast_node_type {
         AST_NODE_NUMBER   = 0x03,
 };
 
+/*
+ * 'hash' is structural: it covers the type, the data and
+ * the hashes of the children. It is set when the node is created
+ * or its data is set. Children assigned afterwards are
+ * not covered until hash_tree().
+ */
 struct ast_node {
         ast_node *left  = nullptr;
         ast_node *right = nullptr;
@@ -38,25 +46,93 @@ ast_node *create_ast_number(double number);
 ast_node *create_ast_ident  (const char *ident);
 
 /*
- * Jumps from node to node recursively. 
+ * Jumps from node to node (see walk_tree()).
  * Then applies 'action' to the current node.
  *
  * Note! It calls action() before next jump.
  */
 void visit_tree(ast_node *root, void (*action)(ast_node *nd));
 
-void free_tree(ast_node *root);
+/*
+ * Nodes are allocated from the node arena of the calling thread.
+ * Each compilation sets its own and releases all of its trees
+ * at once with free_tree(). Nodes created without an arena
+ * go to the default one, which is released at exit.
+ *
+ * Returns the previous arena, nullptr stands for the default one.
+ */
+arena *use_ast_arena(arena *const nodes);
+void free_tree(arena *const nodes);
+
 ast_node *create_ast_node(int type);
 ast_node *copy_tree(ast_node *n);
 
+/*
+ * Hash-consing table of immutable subtrees.
+ *
+ * While a table is in use by the calling thread, cons_ast_*()
+ * return the existing node equal to the requested one
+ * instead of creating a new one. Children are compared
+ * by address, so equal consed subtrees are the same node
+ * and their equality check is O(1).
+ *
+ * Consed nodes may be shared and must never be changed.
+ * Without a table cons_ast_*() just create the node.
+ * Identifiers are compared by address, they must be interned.
+ * Nodes stay in their arena, so free the table together
+ * with the arena. Zero initialized table is ready to use.
+ */
+struct ast_cons {
+        ast_node **slots = nullptr;
+        size_t capacity  = 0;
+        size_t size      = 0;
+};
+
+/*
+ * Returns the previous table, nullptr if there was none.
+ */
+ast_cons *use_ast_cons(ast_cons *const table);
+void free_ast_cons(ast_cons *const table);
+
+/*
+ * 'value' gives the type, the data and the children.
+ */
+ast_node *cons_ast_node(const ast_node *value);
+
+ast_node *cons_ast_keyword(int keyword, ast_node *left, ast_node *right);
+ast_node *cons_ast_number (double number);
+ast_node *cons_ast_ident  (const char *ident, ast_node *right);
+
+uint32_t hash_ast_node(const ast_node *n);
+
+/*
+ * Rehashes nodes whose children were assigned after creation.
+ */
+void hash_tree(ast_node *root);
+
 void save_ast_tree(FILE *file, ast_node *const tree);
-ast_node *read_ast_tree(char **str, array *const idents);
+ast_node *read_ast_tree(char **str, interner *const idents);
 
+/*
+ * Number of nodes, shared ones are counted every time.
+ */
 size_t calc_tree_size(ast_node *n);
+
+/*
+ * Returns the subtree of 't1' where the trees start to differ
+ * ('t2' if 't1' has no such subtree), nullptr if they are equal.
+ * Hashes must be up to date, different hashes are different trees.
+ */
 ast_node *compare_trees(ast_node *t1, ast_node *t2);
 
 const char *ast_keyword_string(int keyword);
 
+/*
+ * AST keyword spelled exactly as 'str' of 'length' characters.
+ * Returns -1 if there is no such keyword.
+ */
+int find_ast_keyword(const char *str, size_t length);
+
 #define TREE_DEBUG
 
 #ifdef TREE_DEBUG
@@ -0,0 +1,54 @@
+#ifndef WALK_H
+#define WALK_H
+
+#include <ast/tree.h>
+#include <ast/flat.h>
+
+/*
+ * Depth-first traversal on an explicit stack.
+ *
+ * Statements are chained through 'left', so a big program is
+ * a very deep tree. The walk keeps pending nodes in a heap array
+ * instead of the C stack, the depth is limited only by memory.
+ *
+ * Every node gets pre() before its children, in() between them
+ * and post() after them. Any callback may be nullptr. The result
+ * of a callback controls the walk:
+ *
+ *      WALK_NEXT  go on
+ *      WALK_SKIP  pre() skips the children, in() and post() of
+ *                 the node, in() skips the right child
+ *      WALK_STOP  stop the walk
+ */
+enum walk_action {
+        WALK_NEXT = 0,
+        WALK_SKIP = 1,
+        WALK_STOP = 2,
+};
+
+struct ast_visitor {
+        int (*pre) (ast_node *node, void *ctx) = nullptr;
+        int (*in)  (ast_node *node, void *ctx) = nullptr;
+        int (*post)(ast_node *node, void *ctx) = nullptr;
+
+        void *ctx = nullptr;
+};
+
+struct flat_visitor {
+        int (*pre) (const flat_node *node, void *ctx) = nullptr;
+        int (*in)  (const flat_node *node, void *ctx) = nullptr;
+        int (*post)(const flat_node *node, void *ctx) = nullptr;
+
+        void *ctx = nullptr;
+};
+
+/*
+ * Returns 0 if the walk is complete,
+ * 1 if it is stopped or the stack can't grow.
+ */
+int walk_tree(ast_node *root, const ast_visitor *visitor);
+int walk_flat_tree(const flat_tree *const flat, const flat_node *root,
+                   const flat_visitor *visitor);
+
+
+#endif /* WALK_H */
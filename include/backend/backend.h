@@ -1,7 +1,30 @@
 #ifndef BACKEND_H
 #define BACKEND_H
 
-int compile_tree(FILE *output, ast_node *tree);
+struct code_cache;
+struct peephole_stats;
+
+/*
+ * Functions found in 'cache' are not compiled again,
+ * the compiled ones are stored there. Nothing is cached
+ * without a cache.
+ *
+ * Functions are compiled on at most 'n_threads' threads.
+ *
+ * With 'optimize' the tree goes through fold_constants(), small
+ * integer powers are multiplied out and the code goes through
+ * peephole(). Passes applied to the compiled functions are
+ * added to 'stats'.
+ */
+struct backend_options {
+        code_cache *cache = nullptr;
+        size_t n_threads  = 1;
+
+        bool optimize = true;
+        peephole_stats *stats = nullptr;
+};
+
+int compile_tree(FILE *output, const flat_tree *tree, const backend_options *options);
 
 
 #endif /* BACKEND_H */
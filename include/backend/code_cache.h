@@ -0,0 +1,49 @@
+#ifndef CODE_CACHE_H
+#define CODE_CACHE_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+/*
+ * Content-addressed cache of compiled functions.
+ *
+ * An entry is the text of a function subtree (see save_flat_tree())
+ * with the code emitted for it. Entries live in their own files in
+ * 'dir', named by the hash of the subtree and of the 'context'.
+ * The context covers everything the code depends on outside of
+ * the function: the global variables and the function signatures.
+ * Entries of another context are never used.
+ *
+ * Lookups and stores may run on several threads at once.
+ */
+struct code_cache {
+        const char *dir  = nullptr;
+        uint64_t context = 0;
+
+        size_t n_hits   = 0;
+        size_t n_misses = 0;
+};
+
+/*
+ * Creates 'dir' if there is no such directory. Returns 0 on success.
+ */
+int open_code_cache(code_cache *const cache, const char *dir);
+
+uint64_t hash_bytes(uint64_t hash, const void *data, size_t size);
+
+/*
+ * Writes the code of 'tree' to 'out' if it is cached.
+ * Returns true on hit.
+ */
+bool find_cached_code(code_cache *const cache, const char *tree, size_t tree_size,
+                      FILE *out);
+
+/*
+ * Returns 0 on success. Nothing is changed on failure,
+ * the entry is just missing next time.
+ */
+int store_cached_code(code_cache *const cache, const char *tree, size_t tree_size,
+                      const char *code, size_t code_size);
+
+
+#endif /* CODE_CACHE_H */
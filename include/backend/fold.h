@@ -0,0 +1,18 @@
+#ifndef FOLD_H
+#define FOLD_H
+
+#include <ast/flat.h>
+
+/*
+ * Copies 'tree' to the empty 'folded' with the values known
+ * at compile time in place: constant subexpressions and
+ * the inv globals they use become numbers.
+ *
+ * Values are computed as the machine computes them, and
+ * a number replaces a subtree only if print_ir() prints it
+ * exactly (see ir.h). Returns 0 on success.
+ */
+int fold_constants(const flat_tree *const tree, flat_tree *const folded);
+
+
+#endif /* FOLD_H */
@@ -0,0 +1,43 @@
+#ifndef IDENT_MAP_H
+#define IDENT_MAP_H
+
+#include <stddef.h>
+
+struct ident_slot {
+        const char *ident = nullptr;
+        size_t      index = 0;
+};
+
+/*
+ * Hash table from interned identifiers to indices of
+ * the tables that own the entries.
+ *
+ * Identifiers are compared by address. The first index added
+ * for an identifier is found until it is removed, later ones
+ * are ignored. Zero initialized map is ready to use.
+ */
+struct ident_map {
+        ident_slot *slots = nullptr;
+        size_t capacity   = 0;
+        size_t size       = 0;
+};
+
+/*
+ * Returns 0 on success.
+ */
+int ident_map_add(ident_map *const map, const char *ident, size_t index);
+
+/*
+ * Returns false if there is no such identifier.
+ */
+bool ident_map_find(const ident_map *const map, const char *ident, size_t *index);
+
+/*
+ * Removes 'ident' if it is mapped to 'index'.
+ */
+void ident_map_remove(ident_map *const map, const char *ident, size_t index);
+
+void free_ident_map(ident_map *const map);
+
+
+#endif /* IDENT_MAP_H */
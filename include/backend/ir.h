@@ -0,0 +1,84 @@
+#ifndef IR_H
+#define IR_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <array.h>
+
+/*
+ * Instructions of the virtual machine as the backend emits them.
+ *
+ * Code is an array of ir_instr in program order. Passes work
+ * on it in place and print_ir() turns it into the assembly text.
+ */
+enum ir_opcode {
+#define CMD(name, code, str, hash) \
+        IR_##name = code,
+#include <commands>
+#undef CMD
+
+        /* Pseudo instructions, nothing is executed */
+        IR_LABEL   = 0x100,
+        IR_COMMENT = 0x101,
+};
+
+enum ir_register {
+        IR_NO_REG = 0x00,
+        IR_AX     = 0x01,
+        IR_BX     = 0x02,
+        IR_CX     = 0x03,
+        IR_HX     = 0x04,
+};
+
+enum ir_operand_kind {
+        IR_ARG_NONE  = 0x00,
+        IR_ARG_IMM   = 0x01,
+        IR_ARG_REG   = 0x02,
+        IR_ARG_MEM   = 0x03, /* [base + offset + index]   */
+        IR_ARG_ADDR  = 0x04, /*  base + offset + index    */
+        IR_ARG_LABEL = 0x05, /* name.scope.offset or name */
+        IR_ARG_TEXT  = 0x06,
+};
+
+/*
+ * Label of a node is numbered by its 'offset' in the function
+ * named 'scope'. Labels without a scope are just 'name'.
+ * Names are not copied, they must outlive the code.
+ */
+struct ir_operand {
+        int kind  = IR_ARG_NONE;
+        int base  = IR_NO_REG;
+        int index = IR_NO_REG;
+
+        ptrdiff_t offset = 0;
+        double    imm    = 0;
+
+        const char *name  = nullptr;
+        const char *scope = nullptr;
+};
+
+struct ir_instr {
+        int opcode = 0;
+        int indent = 0;
+
+        ir_operand arg = {};
+};
+
+static inline ir_instr *ir_code(array *const code)
+{
+        return (ir_instr *)code->data;
+}
+
+/*
+ * Returns nullptr if out of memory.
+ */
+ir_instr *ir_emit(array *const code, int opcode, int indent, const ir_operand *arg);
+
+/*
+ * Prints the assembly text of 'code' to 'file'.
+ * Returns 0 on success.
+ */
+int print_ir(FILE *file, const array *const code);
+
+
+#endif /* IR_H */
@@ -0,0 +1,43 @@
+#ifndef PEEPHOLE_H
+#define PEEPHOLE_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <array.h>
+
+enum peephole_pass {
+        PEEP_PUSH_POP      = 0x00, /* push x / pop x,  push x / pop       */
+        PEEP_FRAME         = 0x01, /* adjacent frame adjustments merged  */
+        PEEP_KNOWN_REG     = 0x02, /* register loaded with its own value */
+        PEEP_COMPARE_JUMP  = 0x03, /* neq / push 0 / je  -->  je         */
+        PEEP_JUMP_NEXT     = 0x04, /* jump to the next instruction       */
+        PEEP_DEAD_CODE     = 0x05, /* unreachable after jmp, ret, hlt    */
+
+        N_PEEPHOLE_PASSES,
+};
+
+/*
+ * Instructions are counted without labels and comments.
+ */
+struct peephole_stats {
+        size_t n_before = 0;
+        size_t n_after  = 0;
+
+        size_t applied[N_PEEPHOLE_PASSES] = {};
+};
+
+/*
+ * Rewrites the code (see ir.h) in place until no pattern applies.
+ * Counts go to 'stats' if it is not nullptr.
+ */
+void peephole(array *const code, peephole_stats *const stats);
+
+/*
+ * Adds 'from' to 'to', several threads may add at once.
+ */
+void add_peephole_stats(peephole_stats *const to, const peephole_stats *from);
+
+void dump_peephole_stats(FILE *file, const peephole_stats *stats);
+
+
+#endif /* PEEPHOLE_H */
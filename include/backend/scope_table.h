@@ -2,25 +2,43 @@
 #define SCOPE_TABLE_H
 
 #include <array.h>
+#include <backend/ident_map.h>
 
+/*
+ * Variables are looked up in 'index', the entries
+ * belong to the caller.
+ */
 struct scope_table {
         ptrdiff_t shift = 0;
         array *entries = nullptr;
+
+        ident_map index = {};
 };
 
 struct var_info {
-        ast_node    *node = nullptr;
+        const flat_node *node = nullptr;
         const char *ident = nullptr;
         ptrdiff_t shift = 0;
 };
 
-var_info *scope_table_find(scope_table *const table, ast_node *variable);
-var_info *scope_table_add (scope_table *const table, ast_node *variable);
+var_info *scope_table_find(scope_table *const table, const char *ident);
+
+/*
+ * Variable takes 'length' more slots after its own one,
+ * non-zero length is an array.
+ */
+var_info *scope_table_add (scope_table *const table, const flat_node *variable,
+                           const char *ident, ptrdiff_t length);
 var_info *scope_table_top (scope_table *const table);
 void      scope_table_pop (scope_table *const table);
 
 var_info *scope_table_add_param(scope_table *const table);
 
+/*
+ * Frees the index, not the entries.
+ */
+void free_scope_table(scope_table *const table);
+
 void dump_array_var_info(void *item);
 
 
@@ -1,6 +1,6 @@
 #ifndef FT_COMPILE_H
 #define FT_COMPILE_H
 
-ast_node *grammar_rule(token **toks);
+ast_node *grammar_rule(token_stream *toks);
 
 #endif /* FT_COMPILE_H */
@@ -1,6 +1,8 @@
 #ifndef KEYWORD_H
 #define KEYWORD_H
 
+#include <stddef.h>
+
 enum keyword_type {
 #define   LINKABLE(xxx) xxx
 #define UNLINKABLE(xxx) xxx
@@ -15,5 +17,17 @@ enum keyword_type {
 
 const char *keyword_string(int id);
 
+/*
+ * Linkable keyword spelled exactly as 'str' of 'length' characters.
+ * Returns -1 if there is no such keyword.
+ */
+int find_keyword(const char *str, size_t length);
+
+/*
+ * Unlinkable keyword 'str' starts with. Sets its 'length'.
+ * Returns -1 if there is no such keyword.
+ */
+int match_keyword(const char *str, size_t *length);
+
 
 #endif /* KEYWORD_H */
@@ -1,7 +1,9 @@
 #ifndef TOKEN_H
 #define TOKEN_H
 
+#include <stdint.h>
 #include <array.h>
+#include <interner.h>
 
 enum token_type {
         TOKEN_KEYWORD = 0x01,
@@ -11,6 +13,8 @@ enum token_type {
 
 struct token {
         int type = 0;
+        /* Identifier length, fits into the padding */
+        uint32_t length = 0;
 
         union {
                 const char *ident;
@@ -19,9 +23,187 @@ struct token {
         } data;
 };
 
-token *tokenize(const char *str, array *const variables);
+/*
+ * Sources large enough are split at top-level statements and 
+ * lexed on 'n_threads' threads. Tokens are the same either way,
+ * only the order of names in 'idents' may differ.
+ */
+token *tokenize(const char *str, interner *const idents, size_t n_threads = 1);
+
+/*
+ * Zero-copy tokenize(). Identifiers are views into 'str',
+ * which is null-terminated after every canonical view
+ * at the end, so 'str' must stay alive as long as the tokens.
+ */
+token *tokenize_views(char *str, interner *const idents, size_t n_threads = 1);
 void dump_tokens(const token *toks);
 
+/*
+ * Compact token kinds: keywords in the order of KEYWORDS,
+ * then identifiers and numbers. Fits into a byte.
+ */
+enum token_kind {
+#define   LINKABLE(xxx) xxx
+#define UNLINKABLE(xxx) xxx
+#define KEYWORD(name, keyword, ident) KIND_##name,
+
+#include "../KEYWORDS"
+
+#undef KEYWORD
+#undef LINKABLE
+#undef UNLINKABLE
+
+        KIND_IDENT,
+        KIND_NUMBER,
+};
+
+/*
+ * Structure-of-arrays token buffer.
+ *
+ * The parser only touches 'kinds' and 'payloads': 5 bytes 
+ * per token instead of 16. Payload is the interner index of 
+ * an identifier or the constant pool index of a number.
+ *
+ * Source offsets live in a cold side table as varint deltas, 
+ * with an absolute offset every LOCATION_STEP tokens, 
+ * and line starts to turn offsets into lines and columns.
+ */
+struct token_buffer {
+        uint8_t  *kinds    = nullptr;
+        uint32_t *payloads = nullptr;
+        size_t size     = 0;
+        size_t capacity = 0;
+
+        /* Number literals */
+        array constants = {};
+
+        array deltas      = {};
+        array checkpoints = {};
+        array lines       = {};
+        size_t last_offset = 0;
+        size_t scanned     = 0;
+
+        interner *idents = nullptr;
+};
+
+static const size_t LOCATION_STEP = 64;
+
+/*
+ * Appends 'n_toks' tokens starting at the given source offsets.
+ * Offsets must not decrease. Returns 0 on success.
+ */
+int append_tokens(token_buffer *const buf, const token *toks, 
+                  const size_t *offsets, size_t n_toks);
+
+/*
+ * Records the line starts of 'str' up to 'end'.
+ * Called with growing 'end' as the source is lexed.
+ */
+int append_lines(token_buffer *const buf, const char *str, size_t end);
+
+token decode_token(const token_buffer *const buf, size_t index);
+
+/*
+ * Line and column of the token, both start from 1. 
+ * Returns 0 on success.
+ */
+int token_location(const token_buffer *const buf, size_t index,
+                   size_t *line, size_t *column);
+
+void free_token_buffer(token_buffer *const buf);
+void dump_token_buffer(const token_buffer *const buf);
+
+/*
+ * tokenize_views() into a token buffer. Returns 0 on success.
+ */
+int tokenize_compact(token_buffer *const buf, char *str, 
+                     interner *const idents, size_t n_threads = 1);
+
+/*
+ * Pull-based token stream.
+ *
+ * Either walks an array made by tokenize() or lexes a file through
+ * a fixed-size window, so only the window and the tokens of one 
+ * window are kept in memory. Window grows only if a single lexeme
+ * or comment doesn't fit into it.
+ */
+struct token_pipe;
+
+struct token_stream {
+        const token *toks = nullptr;
+        size_t n_toks     = 0;
+        size_t current    = 0;
+
+        /* Window mode only */
+        int fd          = -1;
+        bool eof        = false;
+        bool failed     = false;
+        char *window    = nullptr;
+        size_t capacity = 0;
+        size_t filled   = 0;
+
+        array     tokens = {};
+        interner *idents = nullptr;
+
+        /* Pipe mode only */
+        token_pipe *pipe = nullptr;
+
+        /* Buffer mode only */
+        const token_buffer *buffer = nullptr;
+        size_t decoded = 0;
+};
+
+static const size_t TOKEN_WINDOW = 64 * 1024;
+
+/*
+ * Stream over 'toks' terminated with KW_STOP.
+ * Tokens are not copied.
+ */
+void open_token_array(token_stream *const ts, const token *toks);
+
+/*
+ * Stream over 'buf', tokens are decoded on demand.
+ */
+void open_token_buffer(token_stream *const ts, const token_buffer *buf);
+
+/*
+ * Stream over the source read from 'fd'. 
+ * Identifiers are copied into 'idents'.
+ * Returns 0 on success. If reading or lexing fails later, 
+ * the stream ends early and 'failed' is set.
+ */
+int open_token_stream(token_stream *const ts, int fd, interner *const idents,
+                      size_t window = TOKEN_WINDOW);
+
+/*
+ * Same as open_token_stream(), but the source is lexed on 
+ * a separate thread which passes tokens through a lock-free ring,
+ * so lexing overlaps with whatever consumes the stream.
+ * 'idents' belongs to the lexer thread until the stream is closed.
+ */
+int open_token_pipe(token_stream *const ts, int fd, interner *const idents,
+                    size_t window = TOKEN_WINDOW);
+
+void close_token_stream(token_stream *const ts);
+
+/*
+ * Token 'ahead' tokens after the current one. KW_STOP is 
+ * returned past the end. Pointer is valid until the next
+ * peek_token() or next_token() call.
+ */
+const token *peek_token(token_stream *const ts, size_t ahead = 0);
+
+/*
+ * Moves to the next token and returns it.
+ */
+const token *next_token(token_stream *const ts);
+
+/*
+ * Location of the current token. Known in buffer mode only.
+ * Returns 0 on success.
+ */
+int stream_location(token_stream *const ts, size_t *line, size_t *column);
+
 
 
 #endif /* TOKEN_H */
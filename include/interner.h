@@ -0,0 +1,75 @@
+#ifndef INTERNER_H
+#define INTERNER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <array.h>
+#include <arena.h>
+
+struct intern_slot {
+        const char *str = nullptr;
+        uint32_t length = 0;
+        uint32_t   hash = 0;
+        /* Index in 'names' of the interner that owns the string */
+        uint32_t  index = 0;
+};
+
+/*
+ * Identifier interner.
+ *
+ * Every distinct string is stored once (null-terminated) in the arena.
+ * Equal strings get the same pointer, so interned identifiers
+ * can be compared by address.
+ *
+ * Zero initialized interner is ready to use.
+ *
+ * In views mode nothing is copied: the canonical string is
+ * the first occurrence in the caller's buffer, which must outlive
+ * the interner. Views are not null-terminated until seal_views().
+ *
+ * An interner with 'parent' is a thread-local cache in front of
+ * a shared one: names it hasn't seen are interned by the parent
+ * under the parent's lock, so every thread gets the same
+ * canonical pointers. Use the parent directly only when
+ * no children are working.
+ */
+struct interner {
+        intern_slot *slots = nullptr;
+        size_t capacity    = 0;
+        bool views         = false;
+
+        /* Interned strings in the order of appearance */
+        array names   = {};
+        arena strings = {};
+
+        interner *parent     = nullptr;
+        pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+};
+
+/*
+ * Returns the canonical copy of 'str' of 'length' characters.
+ * Pointer stays valid until free_interner().
+ * Sets the name's 'index' (see interned()) if it is not nullptr.
+ */
+const char *intern(interner *const idents, const char *str, size_t length,
+                   uint32_t *index = nullptr);
+
+/*
+ * Name with the given index, in the order of appearance.
+ */
+const char *interned(const interner *const idents, uint32_t index);
+
+/*
+ * Null-terminates every canonical view in place.
+ * 'buf' is the writable buffer the views point to. The character
+ * following each view is overwritten, so call it only after
+ * the buffer is no longer scanned.
+ */
+void seal_views(interner *const idents, char *const buf);
+
+void free_interner(interner *const idents);
+void dump_interner(interner *const idents);
+
+
+#endif /* INTERNER_H */
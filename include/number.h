@@ -0,0 +1,20 @@
+#ifndef NUMBER_H
+#define NUMBER_H
+
+#include <stddef.h>
+
+/*
+ * Scans decimal literal at the beginning of 'str':
+ *
+ *      digits ["." [digits]] [("e" | "E") ["+" | "-"] digits]
+ *
+ * Stops at the first character that can't continue the literal,
+ * so it never reads past the literal itself (plus one character).
+ * Sets the correctly rounded value to 'number'.
+ *
+ * Returns the length of the literal, 0 if there is no literal.
+ */
+size_t scan_number(const char *str, double *number);
+
+
+#endif /* NUMBER_H */
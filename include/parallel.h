@@ -0,0 +1,30 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <stddef.h>
+
+/*
+ * Work-sharing thread pool.
+ *
+ * Tasks are numbered 0..n_tasks-1 and handed out through
+ * an atomic counter, so faster threads simply take more of them.
+ * The calling thread works too.
+ */
+
+typedef void (*parallel_task)(void *arg, size_t index);
+
+/*
+ * Runs task(arg, i) for every i < n_tasks on at most 'n_threads'
+ * threads and waits for all of them. Falls back to the calling
+ * thread alone if threads can't be created.
+ */
+void parallel_for(size_t n_tasks, size_t n_threads, 
+                  parallel_task task, void *arg);
+
+/*
+ * Number of online processors, at least 1.
+ */
+size_t online_cpus();
+
+
+#endif /* PARALLEL_H */
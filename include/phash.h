@@ -0,0 +1,133 @@
+#ifndef PHASH_H
+#define PHASH_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+/*
+ * Static keyword tables built at compile time.
+ *
+ * The keyword lists (KEYWORDS, AST) are expanded into arrays of
+ * 'phash_key' and turned into lookup tables by constexpr functions,
+ * so adding a keyword does not make lookups any slower.
+ *
+ * phash_table  -- perfect hash: exact match of a whole word.
+ * prefix_table -- first character dispatch: the keyword a string
+ *                 starts with. Keys sharing the first character are
+ *                 tried in the order they are listed.
+ */
+
+const size_t PHASH_SIZE = 128;
+
+struct phash_key {
+        const char *str = nullptr;
+        size_t   length = 0;
+        int          id = 0;
+};
+
+struct phash_table {
+        const phash_key *keys = nullptr;
+        size_t n_keys         = 0;
+
+        uint32_t seed = 0;
+
+        /* Key index + 1, 0 is an empty slot */
+        uint8_t slots[PHASH_SIZE] = {0};
+};
+
+struct prefix_table {
+        const phash_key *keys = nullptr;
+        size_t n_keys         = 0;
+
+        /* Key index, -1 is the end of the chain */
+        int8_t first[256]       = {0};
+        int8_t next[PHASH_SIZE] = {0};
+};
+
+static constexpr uint32_t phash(const char *str, size_t length, uint32_t seed)
+{
+        uint32_t hash = seed ^ 0x811C9DC5;
+        for (size_t i = 0; i < length; i++) {
+                hash ^= (uint8_t)str[i];
+                hash *= 0x01000193;
+        }
+
+        return hash ^ (hash >> 15);
+}
+
+/*
+ * Searches for the seed without collisions.
+ * Fails to compile if there are too many keys.
+ */
+static constexpr phash_table make_phash_table(const phash_key *keys, size_t n_keys)
+{
+        phash_table table = {};
+        table.keys   = keys;
+        table.n_keys = n_keys;
+
+        for (uint32_t seed = 1; ; seed++) {
+                for (size_t i = 0; i < PHASH_SIZE; i++)
+                        table.slots[i] = 0;
+
+                bool collision = false;
+                for (size_t i = 0; i < n_keys && !collision; i++) {
+                        size_t slot = phash(keys[i].str, keys[i].length, seed) & (PHASH_SIZE - 1);
+                        if (table.slots[slot])
+                                collision = true;
+
+                        table.slots[slot] = (uint8_t)(i + 1);
+                }
+
+                if (!collision) {
+                        table.seed = seed;
+                        return table;
+                }
+        }
+}
+
+static constexpr prefix_table make_prefix_table(const phash_key *keys, size_t n_keys)
+{
+        prefix_table table = {};
+        table.keys   = keys;
+        table.n_keys = n_keys;
+
+        for (size_t i = 0; i < 256; i++)
+                table.first[i] = -1;
+
+        for (size_t i = n_keys; i-- > 0; ) {
+                uint8_t ch = (uint8_t)keys[i].str[0];
+                table.next[i]   = table.first[ch];
+                table.first[ch] = (int8_t)i;
+        }
+
+        return table;
+}
+
+static inline const phash_key *phash_find(const phash_table *table,
+                                          const char *str, size_t length)
+{
+        uint8_t slot = table->slots[phash(str, length, table->seed) & (PHASH_SIZE - 1)];
+        if (!slot)
+                return nullptr;
+
+        const phash_key *key = &table->keys[slot - 1];
+        if (key->length != length || memcmp(key->str, str, length))
+                return nullptr;
+
+        return key;
+}
+
+static inline const phash_key *prefix_find(const prefix_table *table, const char *str)
+{
+        for (int i = table->first[(uint8_t)*str]; i >= 0; i = table->next[i]) {
+                const phash_key *key = &table->keys[i];
+                if (!strncmp(key->str, str, key->length))
+                        return key;
+        }
+
+        return nullptr;
+}
+
+
+#endif /* PHASH_H */
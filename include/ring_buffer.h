@@ -1,56 +1,47 @@
 #ifndef RING_BUFFER_H
 #define RING_BUFFER_H
 
-#include <stdlib.h>
-#include <logs.h>
-
+#include <stddef.h>
+
+/*
+ * Single-producer single-consumer lock-free ring buffer.
+ *
+ * Items of 'item_size' bytes are copied in and out. Exactly one
+ * thread may push and exactly one thread may pop at a time,
+ * no locks are taken. Each side caches the other side's index 
+ * and rereads it only when the ring looks full (empty).
+ *
+ * Capacity is rounded up to a power of two.
+ */
 struct ring_buffer {
-        char *data = nullptr;
-        size_t write    = 0;
-        size_t capacity = 0;
+        char *data       = nullptr;
+        size_t capacity  = 0;
+        size_t item_size = 0;
+
+        /* Indices grow forever, the slot is 'index & (capacity - 1)' */
+        char producer_line[64] = {};
+        size_t tail        = 0;
+        size_t cached_head = 0;
+
+        char consumer_line[64] = {};
+        size_t head        = 0;
+        size_t cached_tail = 0;
 };
 
-static inline char *error(const char *msg) 
-{
-        if (msg)
-                fprintf(stderr, "%s\n");
-        return nullptr;
-}
-
-char *create_ring_buffer(ring_buffer *const rb, size_t capacity)
-{
-        rb->data = calloc(capacity, sizeof(char));
-        if (!buf)
-                return error("Ring buffer calloc fail");
-
-        rb->capacity = capacity;
-        rb->write = 0;
-
-        return rb;
-}
-
-char *delete_ring_buffer(ring_buffer *const rb)
-{
-        free(rb->data);
-        rb->capacity = 0;
-        rb->write = 0;
-
-        return rb;
-}
+ring_buffer *create_ring_buffer(ring_buffer *const rb, size_t capacity, size_t item_size);
+ring_buffer *delete_ring_buffer(ring_buffer *const rb);
 
-void dump_ring_buffer(ring_buffer *const rb)
-{
-        assert(rb);
-        fprintf(logs, html(bold("Ring buffer %p dump:\n"), rb));
-        for (size_t i = 0; i < rb->capacity; i++)
-                fprintf(logs, html(blue,"|'%c'"), rb->buf[i]);
+/*
+ * Producer side. Returns false if the ring is full.
+ */
+bool ring_buffer_push(ring_buffer *const rb, const void *item);
 
-        fprintf(logs, "|\n");
+/*
+ * Consumer side. Returns false if the ring is empty.
+ */
+bool ring_buffer_pop(ring_buffer *const rb, void *item);
 
-        for (size_t i = 0; i < rb->capacity; i++)
-                fprintf(logs, html(blue," %d "), i);
+void dump_ring_buffer(ring_buffer *const rb);
 
-        fprintf(logs, "\n");
-}
 
 #endif /* RING_BUFFER_H */
@@ -0,0 +1,39 @@
+#ifndef SKIP_H
+#define SKIP_H
+
+/*
+ * Vectorized scanners for the lexer.
+ *
+ * SSE2 or AVX2 implementation is chosen at startup depending on
+ * the CPU, scalar one is used everywhere else. Scanners may read
+ * the whole aligned block the terminating character lies in,
+ * but never cross a page boundary.
+ */
+
+enum skip_impl {
+        SKIP_SCALAR = 0,
+        SKIP_SSE2   = 1,
+        SKIP_AVX2   = 2,
+};
+
+/*
+ * Returns pointer to the first character of 'str'
+ * which is not a space (in terms of isspace() in "C" locale).
+ */
+const char *skip_spaces(const char *str);
+
+/*
+ * Returns pointer to the first 'ch' or '\0' in 'str'.
+ */
+const char *skip_until(const char *str, char ch);
+
+/*
+ * Forces implementation. Falls back to the best supported one
+ * if 'impl' is not available. Returns the implementation in use.
+ */
+skip_impl use_skip_impl(skip_impl impl);
+
+const char *skip_impl_string(skip_impl impl);
+
+
+#endif /* SKIP_H */
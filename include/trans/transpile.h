@@ -1,7 +1,7 @@
 #ifndef TRANSPILE_H
 #define TRANSPILE_H
 
-ast_node *trans_stmt(FILE *file, ast_node *root);
+int transpile_tree(FILE *file, const flat_tree *tree);
 
 
 #endif /* TRANSPILE_H */
@@ -0,0 +1,71 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <assert.h>
+#include <logs.h>
+#include <array.h>
+#include <arena.h>
+
+static const size_t SLAB_SIZE = 64 * 1024;
+
+static char *create_slab(arena *const mem, size_t size)
+{
+        assert(mem);
+
+        char *slab = (char *)calloc(size, sizeof(char));
+        if (!slab) {
+                fprintf(logs, "Can't create arena slab\n");
+                return nullptr;
+        }
+
+        if (!array_push(&mem->slabs, &slab, sizeof(char *))) {
+                free(slab);
+                return nullptr;
+        }
+
+        return slab;
+}
+
+void *arena_alloc(arena *const mem, size_t size, size_t align)
+{
+        assert(mem);
+        assert(align && !(align & (align - 1)));
+
+        size_t pad = -(uintptr_t)mem->top & (align - 1);
+        if (mem->top && pad + size <= mem->left) {
+                void *ptr = mem->top + pad;
+                mem->top  += pad + size;
+                mem->left -= pad + size;
+                return ptr;
+        }
+
+        /*
+         * Big chunks get their own slab,
+         * so the current one is not wasted.
+         */
+        if (size > SLAB_SIZE / 4)
+                return create_slab(mem, size);
+
+        char *slab = create_slab(mem, SLAB_SIZE);
+        if (!slab)
+                return nullptr;
+
+        mem->top  = slab + size;
+        mem->left = SLAB_SIZE - size;
+
+        return slab;
+}
+
+void free_arena(arena *const mem)
+{
+        assert(mem);
+
+        char **slabs = (char **)mem->slabs.data;
+        for (size_t i = 0; i < mem->slabs.size; i++) {
+                free(slabs[i]);
+        }
+
+        free_array(&mem->slabs, sizeof(char *));
+
+        mem->top  = nullptr;
+        mem->left = 0;
+}
@@ -85,6 +85,34 @@ void *array_push(array *const arr, void *item, size_t item_size)
         return (char *)data + item_size * arr->size++;
 }
 
+void *array_append(array *const arr, const void *items, size_t n_items,
+                   size_t item_size)
+{
+        assert(arr);
+        assert(items && n_items);
+        assert(item_size);
+
+        if (validate_size(arr, item_size))
+                return nullptr;
+
+        void *data = arr->data;
+        if (arr->size + n_items > arr->capacity) {
+                size_t capacity = arr->capacity * 2;
+                if (capacity < arr->size + n_items)
+                        capacity = arr->size + n_items;
+
+                data = realloc_array(arr, capacity, item_size);
+                if (!data)
+                        return nullptr;
+        }
+
+        char *dest = (char *)data + item_size * arr->size;
+        memcpy(dest, items, item_size * n_items);
+
+        arr->size += n_items;
+        return dest;
+}
+
 void *array_top(array *const arr, size_t item_size)
 {
         assert(arr);
@@ -0,0 +1,164 @@
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <logs.h>
+#include <array.h>
+#include <arena.h>
+#include <interner.h>
+
+static const size_t INIT_CAPACITY = 64;
+
+static inline uint32_t hash_string(const char *str, size_t length)
+{
+        uint32_t hash = 0x811C9DC5;
+        for (size_t i = 0; i < length; i++) {
+                hash ^= (uint8_t)str[i];
+                hash *= 0x01000193;
+        }
+
+        return hash;
+}
+
+static intern_slot *find_slot(intern_slot *slots, size_t capacity,
+                              const char *str, size_t length, uint32_t hash)
+{
+        assert(slots);
+        assert(str);
+
+        size_t mask = capacity - 1;
+        for (size_t i = hash & mask; ; i = (i + 1) & mask) {
+                intern_slot *slot = &slots[i];
+                if (!slot->str)
+                        return slot;
+
+                if (slot->hash == hash && slot->length == length &&
+                    !memcmp(slot->str, str, length))
+                        return slot;
+        }
+}
+
+static int expand_slots(interner *const idents)
+{
+        assert(idents);
+
+        size_t capacity = idents->capacity ? idents->capacity * 2 : INIT_CAPACITY;
+
+        intern_slot *slots = (intern_slot *)calloc(capacity, sizeof(intern_slot));
+        if (!slots) {
+                fprintf(logs, "Can't expand interner\n");
+                return 1;
+        }
+
+        for (size_t i = 0; i < idents->capacity; i++) {
+                intern_slot *old = &idents->slots[i];
+                if (!old->str)
+                        continue;
+
+                *find_slot(slots, capacity, old->str, old->length, old->hash) = *old;
+        }
+
+        free(idents->slots);
+        idents->slots    = slots;
+        idents->capacity = capacity;
+
+        return 0;
+}
+
+const char *intern(interner *const idents, const char *str, size_t length,
+                   uint32_t *index)
+{
+        assert(idents);
+        assert(str);
+
+        /* Keep load factor below 1/2 */
+        if (idents->names.size * 2 >= idents->capacity) {
+                if (expand_slots(idents))
+                        return nullptr;
+        }
+
+        uint32_t hash = hash_string(str, length);
+        intern_slot *slot = find_slot(idents->slots, idents->capacity, str, length, hash);
+        if (slot->str) {
+                if (index)
+                        *index = slot->index;
+
+                return slot->str;
+        }
+
+        const char *canon = str;
+        uint32_t canon_index = (uint32_t)idents->names.size;
+        if (idents->parent) {
+                pthread_mutex_lock(&idents->parent->lock);
+                canon = intern(idents->parent, str, length, &canon_index);
+                pthread_mutex_unlock(&idents->parent->lock);
+
+                if (!canon)
+                        return nullptr;
+        } else if (!idents->views) {
+                char *copy = (char *)arena_alloc(&idents->strings, length + 1, 1);
+                if (!copy)
+                        return nullptr;
+
+                memcpy(copy, str, length);
+                copy[length] = '\0';
+                canon = copy;
+        }
+
+        if (!array_push(&idents->names, &canon, sizeof(char *)))
+                return nullptr;
+
+        slot->str    = canon;
+        slot->length = (uint32_t)length;
+        slot->hash   = hash;
+        slot->index  = canon_index;
+
+        if (index)
+                *index = canon_index;
+
+        return canon;
+}
+
+const char *interned(const interner *const idents, uint32_t index)
+{
+        assert(idents);
+        assert(index < idents->names.size);
+
+        return ((const char **)idents->names.data)[index];
+}
+
+void seal_views(interner *const idents, char *const buf)
+{
+        assert(idents);
+        assert(buf);
+        assert(idents->views);
+
+        for (size_t i = 0; i < idents->capacity; i++) {
+                intern_slot *slot = &idents->slots[i];
+                if (!slot->str)
+                        continue;
+
+                buf[slot->str - buf + slot->length] = '\0';
+        }
+}
+
+void free_interner(interner *const idents)
+{
+        assert(idents);
+
+        free(idents->slots);
+        idents->slots    = nullptr;
+        idents->capacity = 0;
+
+        free_array(&idents->names, sizeof(char *));
+        free_arena(&idents->strings);
+}
+
+void dump_interner(interner *const idents)
+{
+        assert(idents);
+
+        fprintf(logs, "Interner %p: %lu names, %lu slots\n",
+                      idents, idents->names.size, idents->capacity);
+
+        dump_array(&idents->names, sizeof(char *), array_string);
+}
@@ -0,0 +1,137 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+#include <logs.h>
+#include <number.h>
+
+/* Doubles represent every integer up to 2^53 exactly */
+static const uint64_t MAX_EXACT  = (uint64_t)1 << 53;
+static const uint64_t MAX_DIGITS = 19;
+
+/* Exactly representable powers of ten */
+static const double POW10[] = {
+        1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,
+        1e8,  1e9,  1e10, 1e11, 1e12, 1e13, 1e14, 1e15,
+        1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+};
+
+static const int MAX_POW10 = sizeof(POW10) / sizeof(double) - 1;
+
+static const size_t SLOW_BUFSIZE = 128;
+
+static inline bool is_digit(char ch)
+{
+        return (unsigned char)(ch - '0') < 10;
+}
+
+static double slow_number(const char *str, size_t length);
+
+size_t scan_number(const char *str, double *number)
+{
+        assert(str);
+        assert(number);
+
+        const char *iter = str;
+        if (!is_digit(*iter))
+                return 0;
+
+        uint64_t mantissa = 0;
+        uint64_t n_digits = 0;
+        long     exponent = 0;
+        bool     inexact  = false;
+
+        for (; is_digit(*iter); iter++) {
+                if (n_digits < MAX_DIGITS) {
+                        mantissa = mantissa * 10 + (uint64_t)(*iter - '0');
+                        n_digits += mantissa != 0;
+                } else {
+                        exponent++;
+                        inexact |= *iter != '0';
+                }
+        }
+
+        /* Integer fast path */
+        if (*iter != '.' && *iter != 'e' && *iter != 'E' && !inexact &&
+            exponent == 0 && mantissa <= MAX_EXACT) {
+                *number = (double)mantissa;
+                return (size_t)(iter - str);
+        }
+
+        if (*iter == '.') {
+                for (iter++; is_digit(*iter); iter++) {
+                        if (n_digits < MAX_DIGITS) {
+                                mantissa = mantissa * 10 + (uint64_t)(*iter - '0');
+                                n_digits += mantissa != 0;
+                                exponent--;
+                        } else {
+                                inexact |= *iter != '0';
+                        }
+                }
+        }
+
+        if (*iter == 'e' || *iter == 'E') {
+                const char *exp = iter + 1;
+                bool negative = false;
+                if (*exp == '+' || *exp == '-')
+                        negative = *exp++ == '-';
+
+                if (is_digit(*exp)) {
+                        long value = 0;
+                        for (; is_digit(*exp); exp++) {
+                                if (value < 100000)
+                                        value = value * 10 + (*exp - '0');
+                        }
+
+                        exponent += negative ? -value : value;
+                        iter = exp;
+                }
+        }
+
+        size_t length = (size_t)(iter - str);
+
+        /*
+         * Both mantissa and the power of ten are exact,
+         * so a single operation gives the correctly rounded result.
+         */
+        if (!inexact && mantissa <= MAX_EXACT &&
+            exponent >= -MAX_POW10 && exponent <= MAX_POW10) {
+                if (exponent < 0)
+                        *number = (double)mantissa / POW10[-exponent];
+                else
+                        *number = (double)mantissa * POW10[exponent];
+
+                return length;
+        }
+
+        *number = slow_number(str, length);
+        return length;
+}
+
+/*
+ * strtod() is correctly rounded, but it accepts more than
+ * our literals do. Give it exactly the scanned characters.
+ */
+static double slow_number(const char *str, size_t length)
+{
+        assert(str);
+
+        char buf[SLOW_BUFSIZE] = {0};
+        char *copy = buf;
+        if (length >= SLOW_BUFSIZE) {
+                copy = (char *)calloc(length + 1, sizeof(char));
+                if (!copy)
+                        return 0;
+        }
+
+        memcpy(copy, str, length);
+        copy[length] = '\0';
+
+        double number = strtod(copy, nullptr);
+
+        if (copy != buf) {
+                free(copy);
+        }
+
+        return number;
+}
@@ -0,0 +1,66 @@
+#include <pthread.h>
+#include <unistd.h>
+#include <assert.h>
+#include <logs.h>
+#include <parallel.h>
+
+static const size_t MAX_THREADS = 64;
+
+struct parallel_pool {
+        parallel_task task = nullptr;
+        void *arg          = nullptr;
+
+        size_t n_tasks = 0;
+        size_t next    = 0;
+};
+
+static void *worker(void *data)
+{
+        assert(data);
+        parallel_pool *pool = (parallel_pool *)data;
+
+        size_t index = 0;
+        while ((index = __atomic_fetch_add(&pool->next, 1, __ATOMIC_RELAXED)) < pool->n_tasks)
+                pool->task(pool->arg, index);
+
+        return nullptr;
+}
+
+void parallel_for(size_t n_tasks, size_t n_threads, 
+                  parallel_task task, void *arg)
+{
+        assert(task);
+
+        if (n_threads > n_tasks)
+                n_threads = n_tasks;
+        if (n_threads > MAX_THREADS)
+                n_threads = MAX_THREADS;
+
+        parallel_pool pool = {};
+        pool.task    = task;
+        pool.arg     = arg;
+        pool.n_tasks = n_tasks;
+
+        pthread_t threads[MAX_THREADS] = {};
+        size_t n_started = 0;
+        for (; n_started + 1 < n_threads; n_started++) {
+                if (pthread_create(&threads[n_started], nullptr, worker, &pool)) {
+                        fprintf(logs, "Can't create thread, %lu started\n", n_started);
+                        break;
+                }
+        }
+
+        worker(&pool);
+
+        for (size_t i = 0; i < n_started; i++)
+                pthread_join(threads[i], nullptr);
+}
+
+size_t online_cpus()
+{
+        long n_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        if (n_cpus < 1)
+                return 1;
+
+        return (size_t)n_cpus;
+}
@@ -0,0 +1,96 @@
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <logs.h>
+#include <ring_buffer.h>
+
+static inline ring_buffer *error(const char *msg) 
+{
+        if (msg)
+                fprintf(logs, "%s\n", msg);
+        return nullptr;
+}
+
+ring_buffer *create_ring_buffer(ring_buffer *const rb, size_t capacity, size_t item_size)
+{
+        assert(rb);
+        assert(capacity);
+        assert(item_size);
+
+        size_t size = 1;
+        while (size < capacity)
+                size *= 2;
+
+        *rb = {};
+
+        char *data = (char *)calloc(size, item_size);
+        if (!data)
+                return error("Ring buffer calloc fail");
+
+        rb->data      = data;
+        rb->capacity  = size;
+        rb->item_size = item_size;
+
+        return rb;
+}
+
+ring_buffer *delete_ring_buffer(ring_buffer *const rb)
+{
+        assert(rb);
+
+        free(rb->data);
+        *rb = {};
+
+        return rb;
+}
+
+bool ring_buffer_push(ring_buffer *const rb, const void *item)
+{
+        assert(rb);
+        assert(item);
+
+        size_t tail = rb->tail;
+        if (tail - rb->cached_head == rb->capacity) {
+                rb->cached_head = __atomic_load_n(&rb->head, __ATOMIC_ACQUIRE);
+                if (tail - rb->cached_head == rb->capacity)
+                        return false;
+        }
+
+        memcpy(rb->data + (tail & (rb->capacity - 1)) * rb->item_size, item, rb->item_size);
+        __atomic_store_n(&rb->tail, tail + 1, __ATOMIC_RELEASE);
+
+        return true;
+}
+
+bool ring_buffer_pop(ring_buffer *const rb, void *item)
+{
+        assert(rb);
+        assert(item);
+
+        size_t head = rb->head;
+        if (head == rb->cached_tail) {
+                rb->cached_tail = __atomic_load_n(&rb->tail, __ATOMIC_ACQUIRE);
+                if (head == rb->cached_tail)
+                        return false;
+        }
+
+        memcpy(item, rb->data + (head & (rb->capacity - 1)) * rb->item_size, rb->item_size);
+        __atomic_store_n(&rb->head, head + 1, __ATOMIC_RELEASE);
+
+        return true;
+}
+
+void dump_ring_buffer(ring_buffer *const rb)
+{
+        assert(rb);
+
+        size_t head = __atomic_load_n(&rb->head, __ATOMIC_ACQUIRE);
+        size_t tail = __atomic_load_n(&rb->tail, __ATOMIC_ACQUIRE);
+
+        fprintf(logs, html(blue, bold("Ring buffer %p dump:\n")), rb);
+        fprintf(logs, "capacity:  %lu items of %lu bytes\n", rb->capacity, rb->item_size);
+        fprintf(logs, "head:      %lu\n", head);
+        fprintf(logs, "tail:      %lu\n", tail);
+        fprintf(logs, "size:      %lu\n", tail - head);
+        fprintf(logs, "data:      %p\n\n", rb->data);
+}
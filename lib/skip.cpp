@@ -0,0 +1,215 @@
+#include <stdint.h>
+#include <assert.h>
+#include <skip.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SKIP_X86
+#include <immintrin.h>
+#endif /* __x86_64__ || __i386__ */
+
+#define no_asan __attribute__((no_sanitize_address))
+
+static const char *(*SKIP_SPACES)(const char *str)         = nullptr;
+static const char *(*SKIP_UNTIL) (const char *str, char ch) = nullptr;
+
+static inline bool is_space(char ch)
+{
+        return ch == ' ' || (unsigned char)(ch - '\t') <= '\r' - '\t';
+}
+
+static const char *skip_spaces_scalar(const char *str)
+{
+        assert(str);
+
+        while (is_space(*str))
+                str++;
+
+        return str;
+}
+
+static const char *skip_until_scalar(const char *str, char ch)
+{
+        assert(str);
+
+        while (*str != ch && *str != '\0')
+                str++;
+
+        return str;
+}
+
+#ifdef SKIP_X86
+
+/*
+ * Blocks are loaded aligned, so the first one is masked
+ * to drop the bytes before 'str'.
+ */
+
+static inline __m128i space_mask_sse2(__m128i block)
+{
+        __m128i range = _mm_sub_epi8(block, _mm_set1_epi8('\t'));
+        __m128i ctrl  = _mm_cmpeq_epi8(_mm_min_epu8(range, _mm_set1_epi8('\r' - '\t')), range);
+
+        return _mm_or_si128(ctrl, _mm_cmpeq_epi8(block, _mm_set1_epi8(' ')));
+}
+
+no_asan static const char *skip_spaces_sse2(const char *str)
+{
+        assert(str);
+
+        uintptr_t shift = (uintptr_t)str & 15;
+        const __m128i *block = (const __m128i *)(str - shift);
+
+        unsigned mask = (unsigned)_mm_movemask_epi8(space_mask_sse2(_mm_load_si128(block)));
+        mask |= (1u << shift) - 1;
+
+        while (mask == 0xFFFF) {
+                block++;
+                mask = (unsigned)_mm_movemask_epi8(space_mask_sse2(_mm_load_si128(block)));
+        }
+
+        return (const char *)block + __builtin_ctz(~mask);
+}
+
+no_asan static const char *skip_until_sse2(const char *str, char ch)
+{
+        assert(str);
+
+        const __m128i target = _mm_set1_epi8(ch);
+        const __m128i zero   = _mm_setzero_si128();
+
+        uintptr_t shift = (uintptr_t)str & 15;
+        const __m128i *block = (const __m128i *)(str - shift);
+
+        __m128i bytes = _mm_load_si128(block);
+        unsigned mask = (unsigned)_mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(bytes, target),
+                                                                 _mm_cmpeq_epi8(bytes, zero)));
+        mask &= ~((1u << shift) - 1);
+
+        while (!mask) {
+                block++;
+                bytes = _mm_load_si128(block);
+                mask  = (unsigned)_mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(bytes, target),
+                                                                 _mm_cmpeq_epi8(bytes, zero)));
+        }
+
+        return (const char *)block + __builtin_ctz(mask);
+}
+
+__attribute__((target("avx2")))
+static inline __m256i space_mask_avx2(__m256i block)
+{
+        __m256i range = _mm256_sub_epi8(block, _mm256_set1_epi8('\t'));
+        __m256i ctrl  = _mm256_cmpeq_epi8(_mm256_min_epu8(range, _mm256_set1_epi8('\r' - '\t')), range);
+
+        return _mm256_or_si256(ctrl, _mm256_cmpeq_epi8(block, _mm256_set1_epi8(' ')));
+}
+
+__attribute__((target("avx2")))
+no_asan static const char *skip_spaces_avx2(const char *str)
+{
+        assert(str);
+
+        uintptr_t shift = (uintptr_t)str & 31;
+        const __m256i *block = (const __m256i *)(str - shift);
+
+        uint32_t mask = (uint32_t)_mm256_movemask_epi8(space_mask_avx2(_mm256_load_si256(block)));
+        mask |= (uint32_t)((1ull << shift) - 1);
+
+        while (mask == 0xFFFFFFFF) {
+                block++;
+                mask = (uint32_t)_mm256_movemask_epi8(space_mask_avx2(_mm256_load_si256(block)));
+        }
+
+        return (const char *)block + __builtin_ctz(~mask);
+}
+
+__attribute__((target("avx2")))
+no_asan static const char *skip_until_avx2(const char *str, char ch)
+{
+        assert(str);
+
+        const __m256i target = _mm256_set1_epi8(ch);
+        const __m256i zero   = _mm256_setzero_si256();
+
+        uintptr_t shift = (uintptr_t)str & 31;
+        const __m256i *block = (const __m256i *)(str - shift);
+
+        __m256i bytes = _mm256_load_si256(block);
+        uint32_t mask = (uint32_t)_mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi8(bytes, target),
+                                                                       _mm256_cmpeq_epi8(bytes, zero)));
+        mask &= ~(uint32_t)((1ull << shift) - 1);
+
+        while (!mask) {
+                block++;
+                bytes = _mm256_load_si256(block);
+                mask  = (uint32_t)_mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi8(bytes, target),
+                                                                       _mm256_cmpeq_epi8(bytes, zero)));
+        }
+
+        return (const char *)block + __builtin_ctz(mask);
+}
+
+#endif /* SKIP_X86 */
+
+skip_impl use_skip_impl(skip_impl impl)
+{
+#ifdef SKIP_X86
+        __builtin_cpu_init();
+
+        if (impl == SKIP_AVX2 && !__builtin_cpu_supports("avx2"))
+                impl = SKIP_SSE2;
+        if (impl == SKIP_SSE2 && !__builtin_cpu_supports("sse2"))
+                impl = SKIP_SCALAR;
+
+        switch (impl) {
+        case SKIP_AVX2:
+                SKIP_SPACES = skip_spaces_avx2;
+                SKIP_UNTIL  = skip_until_avx2;
+                break;
+        case SKIP_SSE2:
+                SKIP_SPACES = skip_spaces_sse2;
+                SKIP_UNTIL  = skip_until_sse2;
+                break;
+        case SKIP_SCALAR:
+        default:
+                SKIP_SPACES = skip_spaces_scalar;
+                SKIP_UNTIL  = skip_until_scalar;
+                impl = SKIP_SCALAR;
+                break;
+        }
+#else /* SKIP_X86 */
+        SKIP_SPACES = skip_spaces_scalar;
+        SKIP_UNTIL  = skip_until_scalar;
+        impl = SKIP_SCALAR;
+#endif /* SKIP_X86 */
+
+        return impl;
+}
+
+__attribute__((constructor))
+static void init_skip()
+{
+        use_skip_impl(SKIP_AVX2);
+}
+
+const char *skip_spaces(const char *str)
+{
+        assert(str);
+        return SKIP_SPACES(str);
+}
+
+const char *skip_until(const char *str, char ch)
+{
+        assert(str);
+        return SKIP_UNTIL(str, ch);
+}
+
+const char *skip_impl_string(skip_impl impl)
+{
+        switch (impl) {
+        case SKIP_SCALAR: return "scalar";
+        case SKIP_SSE2:   return "sse2";
+        case SKIP_AVX2:   return "avx2";
+        default:          return "unknown";
+        }
+}
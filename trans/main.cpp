@@ -3,11 +3,14 @@
 #include <stdlib.h>
 #include <logs.h>
 #include <array.h>
+#include <interner.h>
 #include <errno.h>
 #include <iommap.h>
 #include <time.h>
 
 #include <ast/tree.h>
+#include <ast/flat.h>
+#include <ast/binary.h>
 #include <trans/transpile.h>
 
 static int input_error();
@@ -33,36 +36,32 @@ int main(int argc, char *argv[])
         if (error)
                 return EXIT_FAILURE;
 
-        array idents = {0};
+        interner  idents = {};
+        flat_tree tree   = {};
 
-        ast_node *err = nullptr;
-        char *reader = md.buf;
-        ast_node *tree = read_ast_tree(&reader, &idents);
-        mmap_free(&md);
-        if (!tree)
+        /* Binary tree is used in place, keep the mapping until the end */
+        error = load_flat_tree(md.buf, md.size, &idents, &tree);
+        if (error)
                 goto fail;
 
-        err = trans_stmt(out, tree);
-        if (err)
+        error = transpile_tree(out, &tree);
+        if (error)
                 goto fail;
 
 fail:
-        char **data = (char **)idents.data;
-        for (size_t i = 0; i < idents.size; i++) {
-                free(data[i]);
-        }
-
-        free_array(&idents, sizeof(char *));
+        free_flat_tree(&tree);
+        free_interner(&idents);
+        mmap_free(&md);
         fclose(out);
 
         clock_t end = clock();
 
-        if (!tree || err || error) {
+        if (error) {
                 fprintf(stderr, ascii(red, "Transpilation failed\n"));
                 return EXIT_FAILURE;
         }
 
-        fprintf(stderr, ascii(green, "Transpilation succeed: %lf sec\n"), (end - start) / CLOCKS_PER_SEC);
+        fprintf(stderr, ascii(green, "Transpilation succeed: %lf sec\n"), (double)(end - start) / CLOCKS_PER_SEC);
         return EXIT_SUCCESS;
 }
 
@@ -4,6 +4,8 @@
 #include <logs.h>
 #include <assert.h>
 #include <ast/tree.h>
+#include <ast/flat.h>
+#include <ast/walk.h>
 #include <ast/keyword.h>
 #include <frontend/keyword.h>
 #include <trans/transpile.h>
@@ -11,6 +13,8 @@
 static int INDENT = 0;
 static int INDENT_SPACES = 8;
 
+static const flat_tree *TREE = nullptr;
+
 static void indent()
 {
         INDENT += INDENT_SPACES;
@@ -36,66 +40,66 @@ static void unindent()
 #define require_keyword(node)   if (!node || !keyword(node))    { return trans_error(root); }
 #define require_number(node)  if (!node || !number(node))       { return trans_error(root); }
 
-static int       keyword(ast_node *root);
-static double    *number(ast_node *root);
-static const char *ident(ast_node *root);
-
-static ast_node *trans_define(FILE *file, ast_node *root);
-static ast_node *trans_while(FILE *file, ast_node *root);
-static ast_node *trans_if(FILE *file, ast_node *root);
-static ast_node *trans_define_param(FILE *file, ast_node *root);
-static ast_node *trans_call_param(FILE *file, ast_node *root);
-static ast_node *trans_call(FILE *file, ast_node *root);
-static ast_node *trans_variable(FILE *file, ast_node *root);
-static ast_node *trans_expr(FILE *file, ast_node *root);
-static ast_node *trans_show(FILE *file, ast_node *root);
-static ast_node *trans_out(FILE *file, ast_node *root);
-
-static ast_node *success(ast_node *root)
+static int          keyword(const flat_node *root);
+static const double *number(const flat_node *root);
+static const char   *ident(const flat_node *root);
+
+static inline const flat_node *left (const flat_node *root);
+static inline const flat_node *right(const flat_node *root);
+
+static const flat_node *trans_stmt(FILE *file, const flat_node *root);
+
+static const flat_node *trans_define(FILE *file, const flat_node *root);
+static const flat_node *trans_while(FILE *file, const flat_node *root);
+static const flat_node *trans_if(FILE *file, const flat_node *root);
+static const flat_node *trans_define_param(FILE *file, const flat_node *root);
+static const flat_node *trans_call_param(FILE *file, const flat_node *root);
+static const flat_node *trans_call(FILE *file, const flat_node *root);
+static const flat_node *trans_variable(FILE *file, const flat_node *root);
+static const flat_node *trans_expr(FILE *file, const flat_node *root);
+static const flat_node *trans_show(FILE *file, const flat_node *root);
+static const flat_node *trans_out(FILE *file, const flat_node *root);
+
+/*
+ * Statements and parameters are lists chained through 'left',
+ * the items hang on 'right'. walk_spine() checks the keyword of
+ * every list node and passes items to 'item' in order, writing
+ * 'separator' between them, without recursion.
+ */
+typedef const flat_node *(*item_transpiler)(FILE *file, const flat_node *root);
+
+static const flat_node *walk_spine(FILE *file, const flat_node *root, int list_keyword,
+                                   item_transpiler item, const char *separator);
+
+static const flat_node *success(const flat_node *root)
 {
         return nullptr;
 }
 
-static ast_node *trans_error(ast_node *root)
+static const flat_node *trans_error(const flat_node *root)
 {
         assert(root);
         fprintf(stderr, ascii(red, "Syntax error:\n"));
-        save_ast_tree(stderr, root);
-        $(dump_tree(root);)
+        save_flat_tree(stderr, TREE, root);
+        $(save_flat_tree(logs, TREE, root);)
         fprintf(stderr, "\n");
         return root;
 }
 
-static ast_node *transpile(FILE *file, ast_node *root)
+static const flat_node *trans_out(FILE *file, const flat_node *root)
 {
         assert(file);
         assert(root);
-
-        if (root->left)
-                transpile(file, root->left);
-
-        write("trans\n");
-
-        if (root->right)
-                transpile(file, root->right);
-
-        return success(root);
-}
-
-static ast_node *trans_out(FILE *file, ast_node *root)
-{
-        assert(file);
-        assert(root);
-        ast_node *error = nullptr;
+        const flat_node *error = nullptr;
 
         require(root, AST_OUT);
         write("%s", keyword_string(KW_OUT));
         write("%s", keyword_string(KW_OPEN));
 
-        if (!root->right || root->left)
+        if (!right(root) || left(root))
                 return trans_error(root);
 
-        error = trans_expr(file, root->right);
+        error = trans_expr(file, right(root));
         if (error)
                 return error;
 
@@ -103,26 +107,26 @@ static ast_node *trans_out(FILE *file, ast_node *root)
         return success(root);
 }
 
-static ast_node *trans_show(FILE *file, ast_node *root)
+static const flat_node *trans_show(FILE *file, const flat_node *root)
 {
         assert(file);
         assert(root);
-        ast_node *error = nullptr;
+        const flat_node *error = nullptr;
 
         require(root, AST_OUT);
         write("%s", keyword_string(KW_OUT));
         write("%s", keyword_string(KW_OPEN));
 
-        if (!root->right || !root->left)
+        if (!right(root) || !left(root))
                 return trans_error(root);
 
-        error = trans_variable(file, root->left);
+        error = trans_variable(file, left(root));
         if (error)
                 return error;
 
         write("%s ", keyword_string(KW_COMMA));
 
-        error = trans_expr(file, root->right);
+        error = trans_expr(file, right(root));
         if (error)
                 return error;
 
@@ -130,24 +134,24 @@ static ast_node *trans_show(FILE *file, ast_node *root)
         return success(root);
 }
 
-static ast_node *trans_variable(FILE *file, ast_node *root)
+static const flat_node *trans_variable(FILE *file, const flat_node *root)
 {
         assert(file);
         assert(root);
-        ast_node *error = nullptr;
+        const flat_node *error = nullptr;
 
-        if (root->left) {
-                require(root->left, AST_CONST);
+        if (left(root)) {
+                require(left(root), AST_CONST);
                 write("%s ", keyword_string(KW_CONST));
         }
 
         require_ident(root);
         write("%s", ident(root));
 
-        if (root->right) {
+        if (right(root)) {
                 write("%s", keyword_string(KW_QOPEN));
 
-                error = trans_expr(file, root->right);
+                error = trans_expr(file, right(root));
                 if (error)
                         return error;
 
@@ -157,45 +161,41 @@ static ast_node *trans_variable(FILE *file, ast_node *root)
         return success(root);
 }
 
-static ast_node *trans_call_param(FILE *file, ast_node *root)
+static const flat_node *call_param_item(FILE *file, const flat_node *root)
 {
         assert(file);
         assert(root);
-        ast_node *error = nullptr;
-
-        require(root, AST_PARAM);
-        if (root->left) {
-                error = trans_call_param(file, root->left);
-                if (error)
-                        return error;
-                write("%s ", keyword_string(KW_COMMA));
-        }
 
-        if (!root->right)
+        if (!right(root))
                 return trans_error(root);
 
-        error = trans_expr(file, root->right);
-        if (error)
-                return error;
+        return trans_expr(file, right(root));
+}
 
-        return success(root);
+static const flat_node *trans_call_param(FILE *file, const flat_node *root)
+{
+        assert(file);
+        assert(root);
+
+        return walk_spine(file, root, AST_PARAM, call_param_item,
+                          keyword_string(KW_COMMA));
 }
 
-static ast_node *trans_call(FILE *file, ast_node *root)
+static const flat_node *trans_call(FILE *file, const flat_node *root)
 {
         assert(file);
         assert(root);
-        ast_node *error = nullptr;
+        const flat_node *error = nullptr;
 
         require(root, AST_CALL);
 
-        require_ident(root->left);
-        write("%s", ident(root->left));
+        require_ident(left(root));
+        write("%s", ident(left(root)));
         write("%s", keyword_string(KW_OPEN));
 
-        if (root->right) {
-                require(root->right, AST_PARAM);
-                error = trans_call_param(file, root->right); 
+        if (right(root)) {
+                require(right(root), AST_PARAM);
+                error = trans_call_param(file, right(root)); 
                 if (error)
                         return error;
         }
@@ -204,60 +204,60 @@ static ast_node *trans_call(FILE *file, ast_node *root)
         return success(root);
 }
 
-static ast_node *trans_assign(FILE *file, ast_node *root)
+static const flat_node *trans_assign(FILE *file, const flat_node *root)
 {
         assert(file);
         assert(root);
-        ast_node *error = nullptr;
+        const flat_node *error = nullptr;
 
         require(root, AST_ASSIGN);
 
-        require_ident(root->left);
-        error = trans_variable(file, root->left);
+        require_ident(left(root));
+        error = trans_variable(file, left(root));
         if (error)
                 return error;
 
         write(" %s ", keyword_string(KW_ASSIGN));
 
-        if (!root->right)
+        if (!right(root))
                 return error;
 
-        error = trans_expr(file, root->right);
+        error = trans_expr(file, right(root));
         if (error)
                 return error;
 
         return success(root);
 }
 
-static ast_node *trans_if(FILE *file, ast_node *root)
+static const flat_node *trans_if(FILE *file, const flat_node *root)
 {
         assert(file);
         assert(root);
-        ast_node *error = nullptr;
+        const flat_node *error = nullptr;
 
         require(root, AST_IF);
         write("%s ", keyword_string(KW_IF));
         write("%s",  keyword_string(KW_OPEN));
 
-        if (!root->right)
+        if (!right(root))
                 return trans_error(root);
 
-        error = trans_expr(file, root->left);
+        error = trans_expr(file, left(root));
         if (error)
                 return error;
 
         write("%s ",  keyword_string(KW_CLOSE));
 
-        ast_node *decision = root->right;
+        const flat_node *decision = right(root);
         require(decision, AST_DECISN);
 
-        require(decision->left, AST_STMT);
+        require(left(decision), AST_STMT);
         write("%s\n", keyword_string(KW_BEGIN));
 
         indent();
 
-        require(decision->left, AST_STMT);
-        error = trans_stmt(file, decision->left);
+        require(left(decision), AST_STMT);
+        error = trans_stmt(file, left(decision));
         if (error)
                 return error;
 
@@ -265,13 +265,13 @@ static ast_node *trans_if(FILE *file, ast_node *root)
         write_ind();
         write("%s", keyword_string(KW_END));
 
-        if (decision->right) { 
+        if (right(decision)) { 
                 write(" %s ",  keyword_string(KW_ELSE));
                 write("%s\n", keyword_string(KW_BEGIN));
                 indent();
 
-                require(decision->right, AST_STMT);
-                error = trans_stmt(file, decision->right);
+                require(right(decision), AST_STMT);
+                error = trans_stmt(file, right(decision));
                 if (error)
                         return error;
 
@@ -284,20 +284,20 @@ static ast_node *trans_if(FILE *file, ast_node *root)
         return success(root);
 }
 
-static ast_node *trans_while(FILE *file, ast_node *root)
+static const flat_node *trans_while(FILE *file, const flat_node *root)
 {
         assert(file);
         assert(root);
-        ast_node *error = nullptr;
+        const flat_node *error = nullptr;
 
         require(root, AST_WHILE);
         write("%s ", keyword_string(KW_WHILE));
         write("%s",  keyword_string(KW_OPEN));
 
-        if (!root->right)
+        if (!right(root))
                 return trans_error(root);
 
-        error = trans_expr(file, root->left);
+        error = trans_expr(file, left(root));
         if (error)
                 return error;
 
@@ -306,8 +306,8 @@ static ast_node *trans_while(FILE *file, ast_node *root)
 
         indent();
 
-        require(root->right, AST_STMT);
-        error = trans_stmt(file, root->right);
+        require(right(root), AST_STMT);
+        error = trans_stmt(file, right(root));
         if (error)
                 return error;
 
@@ -317,19 +317,19 @@ static ast_node *trans_while(FILE *file, ast_node *root)
         return success(root);
 }
 
-static ast_node *trans_return(FILE *file, ast_node *root)
+static const flat_node *trans_return(FILE *file, const flat_node *root)
 {
         assert(file);
         assert(root);
-        ast_node *error = nullptr;
+        const flat_node *error = nullptr;
 
         require(root, AST_RETURN);
         write("%s ", keyword_string(KW_RETURN));
 
-        if (!root->right)
+        if (!right(root))
                 return trans_error(root);
 
-        error = trans_expr(file, root->right);
+        error = trans_expr(file, right(root));
         if (error)
                 return error;
 
@@ -337,28 +337,36 @@ static ast_node *trans_return(FILE *file, ast_node *root)
         return success(root);
 }
 
-ast_node *trans_stmt(FILE *file, ast_node *root)
+int transpile_tree(FILE *file, const flat_tree *tree)
 {
         assert(file);
-        assert(root);
+        assert(tree);
 
-        ast_node *error = nullptr;
-        if (keyword(root->left) == AST_STMT) {
-                error = trans_stmt(file, root->left);
-                if (error)
-                        return error;
-        }
+        TREE = tree;
+
+        const flat_node *root = flat_root(tree);
+        if (!root)
+                return 1;
 
+        return trans_stmt(file, root) != nullptr;
+}
+
+static const flat_node *stmt_item(FILE *file, const flat_node *root)
+{
+        assert(file);
+        assert(root);
+
+        const flat_node *error = nullptr;
         write_ind();
-        switch (keyword(root->right)) {
+        switch (keyword(right(root))) {
         case AST_DEFINE:
-                return trans_define(file, root->right);
+                return trans_define(file, right(root));
         case AST_RETURN:
-                return trans_return(file, root->right);
+                return trans_return(file, right(root));
         case AST_WHILE:
-                return trans_while(file, root->right);
+                return trans_while(file, right(root));
         case AST_IF:
-                return trans_if(file, root->right);
+                return trans_if(file, right(root));
         default:
                 break;
         }
@@ -366,18 +374,18 @@ ast_node *trans_stmt(FILE *file, ast_node *root)
         write("%s", keyword_string(KW_ASSERT)); 
         write("%s", keyword_string(KW_OPEN)); 
 
-        switch (keyword(root->right)) {
+        switch (keyword(right(root))) {
         case AST_ASSIGN:
-                error = trans_assign(file, root->right);
+                error = trans_assign(file, right(root));
                 break;
         case AST_CALL:
-                error = trans_call(file, root->right);
+                error = trans_call(file, right(root));
                 break;
         case AST_OUT:
-                error = trans_out(file, root->right);
+                error = trans_out(file, right(root));
                 break;
         case AST_SHOW:
-                error = trans_show(file, root->right);
+                error = trans_show(file, right(root));
                 break;
         default:
                 return trans_error(root);
@@ -392,46 +400,54 @@ ast_node *trans_stmt(FILE *file, ast_node *root)
         return success(root);
 }
 
-static ast_node *trans_define_param(FILE *file, ast_node *root)
+static const flat_node *trans_stmt(FILE *file, const flat_node *root)
 {
         assert(file);
         assert(root);
-        ast_node *error = nullptr;
 
-        require(root, AST_PARAM);
-        if (root->left) {
-                error = trans_define_param(file, root->left);
-                if (error)
-                        return error;
-                write("%s ", keyword_string(KW_COMMA));
-        }
+        return walk_spine(file, root, AST_STMT, stmt_item, nullptr);
+}
 
-        require_ident(root->right);
-        write("%s", ident(root->right));
+static const flat_node *define_param_item(FILE *file, const flat_node *root)
+{
+        assert(file);
+        assert(root);
+
+        require_ident(right(root));
+        write("%s", ident(right(root)));
         return success(root);
 }
 
-static ast_node *trans_define(FILE *file, ast_node *root)
+static const flat_node *trans_define_param(FILE *file, const flat_node *root)
+{
+        assert(file);
+        assert(root);
+
+        return walk_spine(file, root, AST_PARAM, define_param_item,
+                          keyword_string(KW_COMMA));
+}
+
+static const flat_node *trans_define(FILE *file, const flat_node *root)
 {
         assert(file);
         assert(root);
-        ast_node *error = nullptr;
+        const flat_node *error = nullptr;
 
         if (keyword(root) != AST_DEFINE)
                 return trans_error(root);
 
         write("%s ", keyword_string(KW_DEFINE));
 
-        require(root->left, AST_FUNC);
-        ast_node *func = root->left;
+        require(left(root), AST_FUNC);
+        const flat_node *func = left(root);
 
-        require_ident(func->left);
+        require_ident(left(func));
 
-        write("%s", ident(func->left));
+        write("%s", ident(left(func)));
         write("%s", keyword_string(KW_OPEN));
 
-        if (func->right) {
-                error = trans_define_param(file, func->right);
+        if (right(func)) {
+                error = trans_define_param(file, right(func));
                 if (error)
                         return error;
         }
@@ -440,7 +456,7 @@ static ast_node *trans_define(FILE *file, ast_node *root)
         write("%s\n", keyword_string(KW_BEGIN));
         indent();
 
-        error = trans_stmt(file, root->right);
+        error = trans_stmt(file, right(root));
         if (error)
                 return error;
 
@@ -450,23 +466,11 @@ static ast_node *trans_define(FILE *file, ast_node *root)
         return success(root);
 }
 
-static ast_node *trans_expr(FILE *file, ast_node *root)
+/*
+ * Function-like operators with the only argument on the right.
+ */
+static int unary_op(const flat_node *root)
 {
-        assert(file);
-        assert(root);
-        ast_node *error = nullptr;
-
-        if (keyword(root) == AST_CALL)
-                return trans_call(file, root);
-
-        if (ident(root))
-                return trans_variable(file, root);
-
-        if (number(root)) {
-                write("%lg", *number(root));
-                return success(root);
-        }
-
         int op = 0;
         switch (keyword(root)) {
         case AST_SIN:
@@ -479,39 +483,45 @@ static ast_node *trans_expr(FILE *file, ast_node *root)
                 break;
         }
 
-        if (op) {
-                write("%s", keyword_string(op));
-                write("%s", keyword_string(KW_OPEN));
-
-                if (!root->right)
-                        return trans_error(root);
+        return op;
+}
 
-                error = trans_expr(file, root->right);
-                if (error)
-                        return error;
+struct expr_transpiler {
+        FILE *file = nullptr;
+        const flat_node *error = nullptr;
+};
 
-                write("%s", keyword_string(KW_CLOSE));
-                return success(root);
-        }
+static const flat_node *trans_operand(FILE *file, const flat_node *root)
+{
+        assert(file);
+        assert(root);
 
-        if (keyword(root) == AST_IN) {
-                write("%s", keyword_string(KW_IN));
-                write("%s", keyword_string(KW_OPEN));
+        if (keyword(root) == AST_CALL)
+                return trans_call(file, root);
 
-                if (root->left || root->right)
-                        return trans_error(root);
+        if (ident(root))
+                return trans_variable(file, root);
 
-                write("%s", keyword_string(KW_CLOSE));
+        if (number(root)) {
+                write("%lg", *number(root));
                 return success(root);
         }
 
+        /* AST_IN */
+        write("%s", keyword_string(KW_IN));
         write("%s", keyword_string(KW_OPEN));
 
-        if (root->left) {
-                error = trans_expr(file, root->left);
-                if (error)
-                        return error;
-        }
+        if (left(root) || right(root))
+                return trans_error(root);
+
+        write("%s", keyword_string(KW_CLOSE));
+        return success(root);
+}
+
+static const flat_node *trans_operator(FILE *file, const flat_node *root)
+{
+        assert(file);
+        assert(root);
 
 #define TRANS(AST, KW)                                 \
         case AST:                                      \
@@ -539,44 +549,176 @@ static ast_node *trans_expr(FILE *file, ast_node *root)
                         return trans_error(root);
         }
 
-        if (root->right) {
-                error = trans_expr(file, root->right);
-                if (error)
-                        return error;
+        return success(root);
+}
+
+static int expr_open(const flat_node *node, void *ctx)
+{
+        expr_transpiler *trans = (expr_transpiler *)ctx;
+        FILE *file = trans->file;
+
+        int kw = keyword(node);
+        if (!kw || kw == AST_CALL || kw == AST_IN) {
+                trans->error = trans_operand(file, node);
+                return trans->error ? WALK_STOP : WALK_SKIP;
+        }
+
+        int op = unary_op(node);
+        if (op) {
+                if (!right(node)) {
+                        trans->error = trans_error(node);
+                        return WALK_STOP;
+                }
+
+                write("%s", keyword_string(op));
         }
 
+        write("%s", keyword_string(KW_OPEN));
+        return WALK_NEXT;
+}
+
+static int expr_operator(const flat_node *node, void *ctx)
+{
+        expr_transpiler *trans = (expr_transpiler *)ctx;
+
+        if (unary_op(node))
+                return WALK_NEXT;
+
+        trans->error = trans_operator(trans->file, node);
+        return trans->error ? WALK_STOP : WALK_NEXT;
+}
+
+static int expr_close(const flat_node *, void *ctx)
+{
+        FILE *file = ((expr_transpiler *)ctx)->file;
+
         write("%s", keyword_string(KW_CLOSE));
-        return success(root);
+        return WALK_NEXT;
+}
+
+static const flat_node *trans_expr(FILE *file, const flat_node *root)
+{
+        assert(file);
+        assert(root);
+
+        expr_transpiler trans = {};
+        trans.file = file;
+
+        flat_visitor visitor = {};
+        visitor.pre  = expr_open;
+        visitor.in   = expr_operator;
+        visitor.post = expr_close;
+        visitor.ctx  = &trans;
+
+        if (walk_flat_tree(TREE, root, &visitor) && !trans.error)
+                return trans_error(root);
+
+        return trans.error;
+}
+
+struct spine_walker {
+        FILE *file       = nullptr;
+        int list_keyword = 0;
+
+        item_transpiler item  = nullptr;
+        const char *separator = nullptr;
+        bool first            = true;
+
+        const flat_node *error = nullptr;
+};
+
+static int spine_node(const flat_node *node, void *ctx)
+{
+        spine_walker *walker = (spine_walker *)ctx;
+
+        if (keyword(node) != walker->list_keyword) {
+                walker->error = trans_error(node);
+                return WALK_STOP;
+        }
+
+        return WALK_NEXT;
+}
+
+static int spine_item(const flat_node *node, void *ctx)
+{
+        spine_walker *walker = (spine_walker *)ctx;
+        FILE *file = walker->file;
+
+        if (!walker->first && walker->separator)
+                write("%s ", walker->separator);
+
+        walker->first = false;
+
+        walker->error = walker->item(file, node);
+        if (walker->error)
+                return WALK_STOP;
+
+        /* Items are written by 'item', the walk goes down the list only */
+        return WALK_SKIP;
+}
+
+static const flat_node *walk_spine(FILE *file, const flat_node *root, int list_keyword,
+                                   item_transpiler item, const char *separator)
+{
+        assert(file);
+        assert(root);
+        assert(item);
+
+        spine_walker walker = {};
+        walker.file         = file;
+        walker.list_keyword = list_keyword;
+        walker.item         = item;
+        walker.separator    = separator;
+
+        flat_visitor visitor = {};
+        visitor.pre = spine_node;
+        visitor.in  = spine_item;
+        visitor.ctx = &walker;
+
+        if (walk_flat_tree(TREE, root, &visitor) && !walker.error)
+                return trans_error(root);
+
+        return walker.error;
 }
 
-static int keyword(ast_node *root)
+static int keyword(const flat_node *root)
 {
         if (!root)
                 return 0;
 
         if (root->type == AST_NODE_KEYWORD)
-                return ast_keyword(root);
+                return flat_keyword(root);
 
         return 0;
 }
 
-static double *number(ast_node *root)
+static const double *number(const flat_node *root)
 {
         assert(root);
 
         if (root->type == AST_NODE_NUMBER)
-                return &root->data.number;
+                return flat_number(TREE, root);
 
         return nullptr;
 }
 
-static const char *ident(ast_node *root)
+static const char *ident(const flat_node *root)
 {
         assert(root);
 
         if (root->type == AST_NODE_IDENT)
-                return root->data.ident;
+                return flat_ident(TREE, root);
 
         return nullptr;
 }
 
+static inline const flat_node *left(const flat_node *root)
+{
+        return flat_left(TREE, root);
+}
+
+static inline const flat_node *right(const flat_node *root)
+{
+        return flat_right(TREE, root);
+}
+